@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// =================================================================================================
+// S3TC block compression. RGB images are encoded as BC1 (DXT1, 8 bytes per 4x4 block), RGBA images as BC3
+// (DXT5, 16 bytes per 4x4 block), i.e. at 1/6 resp. 1/4 of their uncompressed size.
+// The encoder fits the color endpoints to the (slightly inset) bounding box of each block and picks the
+// indices by projecting the pixels onto the endpoint axis. Bounding box and projection use SSE2 where
+// available. Larger images are encoded by the worker pool, one row of blocks per task.
+// Blocks at the right and bottom edges of images whose size isn't a multiple of 4 repeat their last pixels.
+
+class BlockEncoder {
+    public:
+        static inline size_t BlockSize(int componentCount) {
+            return (componentCount == 4) ? 16 : 8;
+        }
+
+        static inline size_t CompressedSize(int width, int height, int componentCount) {
+            return size_t((width + 3) / 4) * size_t((height + 3) / 4) * BlockSize(componentCount);
+        }
+
+        // encode tightly packed RGB (-> BC1) or RGBA (-> BC3) pixels
+        static void Encode(uint8_t* dest, const uint8_t* pixels, int width, int height, int componentCount, bool parallel = true);
+
+        // decode BC1 or BC3 blocks to tightly packed RGB resp. RGBA pixels
+        static void Decode(uint8_t* dest, const uint8_t* blocks, int width, int height, int componentCount);
+
+        // encode a test image (or the given pixels) serially and in parallel, decode it again and print encoding times,
+        // compression ratio and PSNR
+        static void Benchmark(const uint8_t* pixels = nullptr, int width = 2048, int height = 2048, int componentCount = 4);
+};
+
+// =================================================================================================
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "glew.h"
+#include "vbo.h"
+#include "singletonbase.hpp"
+
+// =================================================================================================
+// Suballocation of a large GL buffer. Allocations are counted in elements of a fixed size (a vertex of
+// a given layout, an index) and referenced by id, so their data can be moved inside the buffer: the
+// buffer grows by copying it to a larger one when an allocation doesn't fit, and Defragment() packs all
+// allocations at the start of the buffer. Free blocks are kept sorted by offset and merged with their
+// neighbours when allocations are freed; allocation takes the first free block that is large enough.
+
+class BufferArena {
+    public:
+        struct Block {
+            size_t  offset; // elements
+            size_t  size;
+        };
+
+        static constexpr uint32_t invalidAllocation = 0xFFFFFFFF;
+
+        GLuint              m_handle;
+        size_t              m_elementSize;  // bytes
+        size_t              m_capacity;     // elements
+        size_t              m_usedSize;
+        std::vector<Block>  m_allocations;  // by id; unused ids have size 0
+        std::vector<uint32_t> m_unusedIds;
+        std::vector<Block>  m_freeBlocks;
+
+        BufferArena()
+            : m_handle(0), m_elementSize(0), m_capacity(0), m_usedSize(0)
+        { }
+
+        ~BufferArena() {
+            Destroy();
+        }
+
+        bool Create(size_t elementSize, size_t capacity);
+
+        void Destroy(void);
+
+        inline GLuint Handle(void) {
+            return m_handle;
+        }
+
+        inline const Block& operator[](uint32_t id) {
+            return m_allocations[id];
+        }
+
+        // copy count elements of data to the buffer. Returns the allocation's id or invalidAllocation.
+        uint32_t Allocate(const void* data, size_t count);
+
+        void Free(uint32_t id);
+
+        // move all allocations to the start of the buffer. Returns false if the allocations didn't move.
+        bool Defragment(void);
+
+        // share of the free space not in the largest free block
+        float Fragmentation(void);
+
+    private:
+        int FindFreeBlock(size_t size);
+
+        void AddFreeBlock(Block block);
+
+        // move the data to a new buffer of the given capacity, packing the allocations if compact is set
+        bool Relocate(size_t capacity, bool compact);
+};
+
+// =================================================================================================
+// A mesh's vertices and indices in the mesh arenas
+
+struct MeshAllocation {
+    int         arena = -1;
+    uint32_t    vertices = BufferArena::invalidAllocation;
+    uint32_t    indices = BufferArena::invalidAllocation;
+    GLsizei     indexCount = 0;
+    GLenum      shape = GL_TRIANGLES;
+
+    MeshAllocation() = default;
+
+    MeshAllocation(const MeshAllocation& other) = default;
+
+    MeshAllocation& operator=(const MeshAllocation& other) = default;
+
+    // the allocation is freed by its owner; moving it leaves an invalid allocation behind
+    MeshAllocation(MeshAllocation&& other) noexcept {
+        Move(other);
+    }
+
+    MeshAllocation& operator=(MeshAllocation&& other) noexcept {
+        return Move(other);
+    }
+
+    MeshAllocation& Move(MeshAllocation& other) {
+        if (this != &other) {
+            arena = other.arena;
+            vertices = other.vertices;
+            indices = other.indices;
+            indexCount = other.indexCount;
+            shape = other.shape;
+            other.arena = -1;
+            other.vertices = BufferArena::invalidAllocation;
+            other.indices = BufferArena::invalidAllocation;
+        }
+        return *this;
+    }
+
+    inline bool IsValid(void) const {
+        return arena >= 0;
+    }
+};
+
+// =================================================================================================
+// Static mesh data of all meshes sharing a vertex layout lives in one vertex and one index arena and is
+// drawn with a single VAO for the layout. Indices stay relative to the mesh's first vertex; the draw
+// call passes the vertex offset as base vertex. This saves the per mesh VBOs and VAO switches.
+// Needs OpenGL 3.2 or ARB_draw_elements_base_vertex and ARB_copy_buffer.
+
+class MeshArenas
+    : public BaseSingleton<MeshArenas>
+{
+    public:
+        struct Arena {
+            VertexLayout    layout;
+            BufferArena     vertices;
+            BufferArena     indices;
+            GLuint          vao = 0;
+            GLuint          vertexHandle = 0; // the buffers the VAO has been set up with; they change when an arena moves its data
+            GLuint          indexHandle = 0;
+        };
+
+        static constexpr size_t initialVertexCapacity = 65536;
+        static constexpr size_t initialIndexCapacity = 3 * 65536;
+
+        std::vector<std::unique_ptr<Arena>> m_arenas;
+
+        static inline bool  isAvailable{ false }; // false after the mesh arenas have been destroyed
+
+        MeshArenas() {
+            isAvailable = true;
+        }
+
+        ~MeshArenas() {
+            Destroy();
+            isAvailable = false;
+        }
+
+        void Destroy(void);
+
+        // requires an OpenGL context
+        static bool IsSupported(void);
+
+        MeshAllocation Allocate(VertexLayout& layout, const void* vertexData, uint32_t vertexCount, const GLuint* indices, uint32_t indexCount, GLenum shape);
+
+        void Free(MeshAllocation& allocation);
+
+        void Render(const MeshAllocation& allocation);
+
+        // pack the data of all arenas, e.g. after many meshes have been destroyed
+        void Defragment(void);
+
+        // print size, use and fragmentation of each arena
+        void ReportStats(void);
+
+    private:
+        int FindArena(VertexLayout& layout);
+
+        void SetupVAO(Arena& arena);
+};
+
+#define meshArenas MeshArenas::Instance()
+
+// =================================================================================================
@@ -11,8 +11,13 @@ class Cubemap : public Texture {
 
         virtual void SetParams (void);
 
+        virtual SamplerState GetSamplerState (void);
+
         virtual void Deploy (int bufferIndex = 0);
 
+    private:
+        void DeployFaces(int firstFace, int faceCount, TextureBuffer* texBuf);
+
 };
 
 // =================================================================================================
@@ -9,6 +9,7 @@
 #include "texture.h"
 #include "vao.h"
 #include "vertexdatabuffers.h"
+#include "bufferarena.h"
 
 // =================================================================================================
 // Mesh class definitions for basic mesh information, allowing to pass child classes to functions
@@ -57,8 +58,27 @@ public:
 class Mesh : public AbstractMesh
 {
 public:
+    // vertex data streams; their attribute locations follow this order, skipping streams without data
+    enum VertexStreams {
+        vsVertex = 1,
+        vsTexCoord = 2,
+        vsColor = 4,
+        vsNormal = 8,
+        vsAll = 15
+    };
+
+    // vertex attribute encodings
+    enum AttribFormats {
+        afFloat,        // 32 bit floats
+        afHalfFloat,    // 16 bit floats (tex coords)
+        afShort,        // normalized 16 bit integers (positions, quantized to the mesh's bounding box; tex coords in [0, 1])
+        afByte,         // normalized 8 bit unsigned integers (colors)
+        afInt1010102    // normalized signed 10:10:10:2 integers (normals)
+    };
+
     String              m_name;
     TextureList         m_textures;
+    TextureList         m_handlerTextures; // textures loaded via the texture handler; released when the mesh is destroyed
     VertexBuffer        m_vertices;
     VertexBuffer        m_normals;
     TexCoordBuffer      m_texCoords;
@@ -68,13 +88,42 @@ public:
     GLenum              m_shape;
     Vector3f            m_vMin;
     Vector3f            m_vMax;
+    bool                m_isContiguous;
+    bool                m_optimize;             // run Optimize() in UpdateVAO()
+    bool                m_isShared;             // keep the mesh data in the mesh arenas instead of the mesh's VAO
+    MeshAllocation      m_sharedAllocation;
+    uint32_t            m_interleavedStreams;   // streams to store interleaved in a single VBO (VertexStreams)
+    uint32_t            m_layoutStreams;        // streams actually interleaved by the last update
+    VertexLayout        m_layout;
+    ManagedArray<uint8_t> m_interleavedData;
+    ManagedArray<uint8_t> m_packedData[4];  // separate streams in a packed format
+    AttribFormats       m_attribFormats[4];
+    int                 m_attribLocations[4];
+    Vector3f            m_positionScale;        // restores quantized positions
+    Vector3f            m_positionBias;
 
     static uint32_t quadTriangleIndices[6];
 
-    Mesh(bool isDynamic = true) {
+    // UpdateVAO() converts the buffers of meshes with at least this many vertices or faces in parallel
+    static constexpr uint32_t parallelSetupThreshold = 16384;
+
+    Mesh(bool isDynamic = true)
+        : m_isContiguous(false), m_optimize(false), m_isShared(false), m_interleavedStreams(0), m_layoutStreams(0)
+        , m_attribFormats{ afFloat, afFloat, afFloat, afFloat }, m_attribLocations{ -1, -1, -1, -1 }
+        , m_positionScale{ 1.0f, 1.0f, 1.0f }, m_positionBias{ 0.0f, 0.0f, 0.0f }
+    {
         SetDynamic(isDynamic);
     }
 
+    // a copy would release the mesh's handler textures and free its shared allocation a second time
+    Mesh(const Mesh&) = delete;
+
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh&&) noexcept = default;
+
+    Mesh& operator=(Mesh&&) noexcept = default;
+
     ~Mesh() {
         Destroy();
     }
@@ -93,6 +142,47 @@ public:
         m_vao.SetDynamic(isDynamic);
     }
 
+    // keep vertex data in contiguous arrays instead of segmented lists (see VertexDataBuffer)
+    void SetContiguous(bool isContiguous);
+
+    // Store the given streams (VertexStreams) interleaved in a single VBO. Streams that are updated frequently should
+    // be left out; they keep a VBO of their own. Takes effect with the next UpdateVAO().
+    inline void SetInterleaved(uint32_t streams = vsAll) {
+        m_interleavedStreams = streams;
+    }
+
+    // Select the encoding of a stream (VertexStreams). Returns false if the stream doesn't support the format:
+    // positions: afFloat, afShort; tex coords: afFloat, afHalfFloat, afShort; colors: afFloat, afByte; normals: afFloat, afInt1010102.
+    // Takes effect with the next UpdateVAO().
+    bool SetAttribFormat(uint32_t stream, AttribFormats format);
+
+    // vertex data size in bytes with the current attribute formats and with all attributes as floats
+    size_t VertexDataSize(bool packed = true);
+
+    // print the bytes saved by packed attribute formats
+    void ReportVertexDataSize(void);
+
+    // Weld duplicate vertices, reorder the triangles for vertex cache locality and the vertices in the order the
+    // triangles use them. Only works for indexed triangle meshes whose streams all have one entry per vertex.
+    // report prints the vertex cache efficiency (ACMR, ATVR) before and after. isSetup tells that the GL data of all
+    // buffers is current (e.g. in UpdateVAO()), so they don't need to be set up again.
+    bool Optimize(bool report = false, bool isSetup = false);
+
+    // have UpdateVAO() optimize the mesh before uploading it (see Optimize())
+    inline void SetOptimize(bool optimize) {
+        m_optimize = optimize;
+    }
+
+    // Have UpdateVAO() put the mesh's vertices (interleaved) and indices into the mesh arenas (see MeshArenas) instead
+    // of VBOs of its own. Only static indexed meshes (or quad meshes getting vertex indices) whose streams all have one
+    // entry per vertex qualify; other meshes keep using their VAO.
+    inline void SetShared(bool isShared) {
+        m_isShared = isShared;
+    }
+
+    // reserve room for vertexCount vertices (and tex coords, colors and normals) in contiguous mode
+    void Reserve(size_t vertexCount);
+
     inline uint32_t ShapeSize(void) {
         if (m_shape == GL_QUADS)
             return 4;
@@ -104,29 +194,41 @@ public:
     }
 
     inline void UpdateVertexBuffer(void) {
-        m_vao.UpdateVertexBuffer("Vertex", m_vertices.GLData(), m_vertices.GLDataSize(), GL_FLOAT, 3);
+        UpdateStreamBuffer(0);
     }
 
     inline void UpdateTexCoordBuffer(void) {
-        m_vao.UpdateVertexBuffer("TexCoord", m_texCoords.GLData(), m_texCoords.GLDataSize(), GL_FLOAT, 2);
+        UpdateStreamBuffer(1);
     }
 
     inline void UpdateColorBuffer(void) {
-        m_vao.UpdateVertexBuffer("Color", m_vertexColors.GLData(), m_vertexColors.GLDataSize(), GL_FLOAT, 4);
+        UpdateStreamBuffer(2);
     }
     // in the case of an icosphere, the vertices also are the vertex normals
     inline void UpdateNormalBuffer(void) {
-        m_vao.UpdateVertexBuffer("Normal", m_normals.GLData(), m_normals.GLDataSize(), GL_FLOAT, 3);
+        UpdateStreamBuffer(3);
     }
 
+    // upload stream i (0: positions, 1: tex coords, 2: colors, 3: normals) in its attribute format to its own VBO.
+    // Rebuilds the interleaved buffer instead if the stream is part of it.
+    void UpdateStreamBuffer(int i);
+
+    // interleave the streams selected by m_interleavedStreams that have one entry per vertex and upload them
+    void UpdateInterleavedBuffer(void);
+
     inline void UpdateIndexBuffer(void) {
-        m_vao.UpdateIndexBuffer(m_indices.GLData(), m_indices.GLDataSize(), GL_UNSIGNED_INT);
+        m_vao.UpdateIndexBuffer(m_indices.IndexData(), m_indices.IndexDataSize(), m_indices.IndexType());
+        m_indices.ClearDirtyRanges();
     }
 
     void UpdateVAO(bool createVertexIndex = false);
 
     void CreateVertexIndices(void);
 
+    // build a quad grid mesh with vertexCount vertices and print the UpdateVAO times with segmented, contiguous and
+    // interleaved vertex data
+    static void BenchmarkUpdateVAO(int vertexCount = 1 << 20);
+
     inline VAO& VAO(void) {
         return m_vao;
     }
@@ -150,7 +252,7 @@ public:
     }
 
     inline void AddTexCoord(SegmentedList<TexCoord>& tc) {
-        m_texCoords.m_appData += tc;
+        m_texCoords.Append(tc);
     }
 
     inline void AddColor(RGBAColor& c) {
@@ -174,6 +276,28 @@ public:
     }
 
     virtual void Render(Shader* shader, Texture* texture);
+
+private:
+    const GLfloat* StreamData(int i, uint32_t& length);
+
+    // type and component count of stream i's attributes in their current format; returns the bytes per vertex
+    GLsizei AttribFormat(int i, GLenum& componentType, GLint& componentCount);
+
+    // encode vertexCount attributes of stream i starting at firstVertex to dest, writing one attribute every stride bytes
+    void PackStream(int i, uint8_t* dest, size_t stride, uint32_t vertexCount, uint32_t firstVertex = 0);
+
+    std::vector<ElementRange>& DirtyRanges(int i);
+
+    // Byte ranges of the stream buffer (or the interleaved buffer, if i < 0) to upload, for attributes of attribSize
+    // bytes. Returns false if the entire buffer needs to be uploaded.
+    bool GetUploadRanges(int i, size_t attribSize, std::vector<BufferRange>& uploadRanges);
+
+    void ComputePositionTransform(void);
+
+    // Build m_layout from those of the given streams that have one entry per vertex. Returns the streams in the layout.
+    uint32_t BuildLayout(uint32_t streams, uint32_t& vertexCount);
+
+    bool UpdateSharedBuffers(bool createVertexIndex);
 };
 
 // =================================================================================================
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// =================================================================================================
+// Optimization of indexed triangle meshes for the GPU's post transform vertex cache and vertex fetch.
+// Welding merges vertices whose attributes are bitwise identical. Triangles are then reordered with Tipsify
+// (Sander, Nehab, Barczak: "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007), which fans
+// around the most recently used vertices and falls back to recently used vertices with remaining triangles when
+// it runs into a dead end. Finally, vertices are renumbered in the order the triangles first reference them, so
+// vertex fetch runs through memory linearly.
+// Cache efficiency is measured as ACMR (average cache miss ratio: vertex shader invocations per triangle; 0.5 is
+// the optimum for large regular meshes, 3 the worst case) and ATVR (average transformed vertex ratio: vertex shader
+// invocations per vertex; 1 is the optimum), simulating a FIFO cache.
+
+class MeshOptimizer {
+    public:
+        struct CacheStats {
+            float   acmr;
+            float   atvr;
+        };
+
+        static constexpr uint32_t   unusedVertex = 0xFFFFFFFF;
+        static constexpr int        defaultCacheSize = 16;
+
+        // Compute remap[i] = unique index of vertex i. Vertices are equal if all their attributes in all streams are
+        // bitwise equal; streams[j] holds componentCounts[j] floats per vertex. Returns the number of unique vertices.
+        static uint32_t Weld(const float* const* streams, const int* componentCounts, int streamCount, uint32_t vertexCount, std::vector<uint32_t>& remap);
+
+        // reorder the triangles of indices in place for vertex cache locality
+        static void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, int cacheSize = defaultCacheSize);
+
+        // Renumber the vertices in the order indices reference them and update indices accordingly. remap[i] receives the new
+        // index of vertex i, or unusedVertex for vertices not referenced. Returns the number of vertices referenced.
+        static uint32_t OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap);
+
+        static CacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, int cacheSize = defaultCacheSize);
+};
+
+// =================================================================================================
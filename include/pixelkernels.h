@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// =================================================================================================
+// Pixel conversion kernels for turning decoded images into OpenGL ready texture data.
+// Each kernel reads the rows of an image with arbitrary (padded) pitch, optionally in reverse order to flip the
+// image vertically, and writes tightly packed RGB(A) rows to dest in a single pass. Alpha is premultiplied on
+// request while the row is still in the cache.
+// The kernels use AVX2, SSSE3 or SSE2 depending on what the CPU supports and fall back to scalar code otherwise.
+
+class PixelKernels {
+    public:
+        enum class InstructionSet {
+            Scalar,
+            SSE2,
+            SSSE3,
+            AVX2
+        };
+
+        static InstructionSet instructionSet;
+
+        static void SetInstructionSet(InstructionSet set);
+
+        static const char* InstructionSetName(InstructionSet set);
+
+        // copy RGB or RGBA rows
+        static void Copy(uint8_t* dest, const uint8_t* source, int width, int height, int pitch, int componentCount, bool flipVertically, bool premultiplyAlpha = false);
+
+        // RGB -> RGBA with alpha = 255
+        static void ExpandRGB(uint8_t* dest, const uint8_t* source, int width, int height, int pitch, bool flipVertically);
+
+        // 8 bit palette indices (incl. grey scale images) -> RGBA. palette holds 256 RGBA colors (byte order r, g, b, a).
+        static void ExpandPalette(uint8_t* dest, const uint8_t* source, const uint32_t* palette, int width, int height, int pitch, bool flipVertically, bool premultiplyAlpha = false);
+
+        static void PremultiplyAlpha(uint8_t* data, int pixelCount);
+
+        // One row of the next mip level from two rows of a width pixels wide image (row1 == row0 for the last row of odd heights)
+        // with a 2x2 box filter. gammaCorrect averages the color channels in linear light instead of their sRGB encoded values,
+        // which keeps mip levels from getting darker. Alpha is always averaged as is.
+        static void DownsampleRow(uint8_t* dest, const uint8_t* row0, const uint8_t* row1, int width, int componentCount, bool gammaCorrect);
+
+        // time the RGB -> RGBA conversion of a width x height image with SDL_ConvertSurfaceFormat and a separate
+        // flip pass against each available kernel instruction set and print the results
+        static void Benchmark(int width = 2048, int height = 2048, int rounds = 10);
+};
+
+// =================================================================================================
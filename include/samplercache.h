@@ -0,0 +1,67 @@
+#pragma once
+
+#include "glew.h"
+#include "list.hpp"
+#include "singletonbase.hpp"
+
+// =================================================================================================
+// Texture sampling parameters. Textures and FBO buffers describe how they want to be sampled with a
+// SamplerState; the sampler cache hands out one GL sampler object per distinct state.
+
+struct SamplerState {
+    GLenum  minFilter = GL_LINEAR;
+    GLenum  magFilter = GL_LINEAR;
+    GLenum  wrapS = GL_CLAMP_TO_EDGE;
+    GLenum  wrapT = GL_CLAMP_TO_EDGE;
+    GLenum  wrapR = GL_CLAMP_TO_EDGE;
+    GLenum  compareMode = GL_NONE;
+
+    inline bool operator== (const SamplerState& other) const {
+        return (minFilter == other.minFilter) and (magFilter == other.magFilter) and (wrapS == other.wrapS) and (wrapT == other.wrapT) and
+               (wrapR == other.wrapR) and (compareMode == other.compareMode);
+    }
+
+    inline bool operator!= (const SamplerState& other) const {
+        return not (*this == other);
+    }
+};
+
+// =================================================================================================
+// Deduplicating cache of GL sampler objects. A sampler bound to a texture unit overrides the sampling
+// parameters of the texture bound there, so textures don't need their parameters set at all, and the
+// same texture can be sampled with different settings. Applications only use a handful of different
+// sampler states, so they are simply kept in a list.
+// Requires OpenGL 3.3 or ARB_sampler_objects; without them, textures set their parameters themselves.
+
+class SamplerCache
+    : public BaseSingleton<SamplerCache>
+{
+    public:
+        struct Sampler {
+            SamplerState    state;
+            GLuint          handle;
+        };
+
+        List<Sampler>   m_samplers;
+
+        ~SamplerCache() {
+            Destroy();
+        }
+
+        // returns 0 if sampler objects are not available
+        GLuint Get(const SamplerState& state);
+
+        void Destroy(void);
+
+        inline int SamplerCount(void) {
+            return int(m_samplers.Length());
+        }
+
+        static inline bool IsAvailable(void) {
+            return GLEW_VERSION_3_3 or GLEW_ARB_sampler_objects;
+        }
+};
+
+#define samplerCache SamplerCache::Instance()
+
+// =================================================================================================
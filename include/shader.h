@@ -36,6 +36,7 @@ class Shader
         String          m_fs;
         ManagedArray<UniformHandle*>    m_uniforms;
         ShaderLocationTable             m_locations;
+        ShaderLocationTable             m_positionLocations;
 
         using KeyType = String;
 
@@ -205,6 +206,9 @@ class Shader
 
         void UpdateMatrices(void);
 
+        // scale and bias the standard vertex shaders apply to vertex positions (see Mesh::SetAttribFormat())
+        void SetPositionTransform(const Vector3f& scale, const Vector3f& bias);
+
         inline const bool operator< (String const& name) const { return m_name < name; }
 
         bool operator> (const String& name) const { return m_name > name; }
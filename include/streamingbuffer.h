@@ -0,0 +1,105 @@
+#pragma once
+
+#include "glew.h"
+#include "array.hpp"
+#include "singletonbase.hpp"
+
+// =================================================================================================
+// Ring buffer for streaming vertex data that is rewritten every frame (e.g. BaseQuad's).
+// With ARB_buffer_storage, one vertex buffer is mapped persistently and coherently and split into
+// regions. Vertex data is copied straight into the current region; VBOs drawing from it only point
+// their attributes at the data's offset in the ring. Once per frame (or when a region is full), a fence
+// is placed behind the commands reading the region and the next region is used. Before a region is
+// written again, its fence is waited for, so data the GPU is still reading is never overwritten; each
+// such wait that actually blocks is counted as a stall.
+// Without buffer storage, the data is written through unsynchronized mappings, and the entire buffer
+// is orphaned whenever the ring wraps around, leaving it to the driver to keep the old storage alive.
+// Data in the ring stays valid until the ring has wrapped around, so only VBOs that are updated before
+// each time they are drawn may stream their data.
+
+class StreamingBuffer
+    : public BaseSingleton<StreamingBuffer>
+{
+    public:
+        struct StreamStats {
+            size_t          bytesStreamed = 0;
+            int             allocationCount = 0;
+            int             overflowCount = 0;  // regions left early because they were full
+            int             orphanCount = 0;
+            int             stallCount = 0;     // waits for the GPU to release a region
+            float           stallTime = 0.0f;   // seconds spent in these waits
+        };
+
+        static constexpr size_t alignment = 16;
+
+        GLuint                  m_handle;
+        uint8_t*                m_data;         // persistent mapping
+        ManagedArray<GLsync>    m_fences;       // one per region
+        size_t                  m_regionSize;
+        size_t                  m_offset;       // bytes used in the current region
+        int                     m_currentRegion;
+        StreamStats             m_stats;
+        bool                    m_isStreaming;
+        bool                    m_isAvailable;
+        bool                    m_isPersistent;
+
+        StreamingBuffer()
+            : m_handle(0), m_data(nullptr), m_regionSize(0), m_offset(0), m_currentRegion(0), m_isStreaming(false), m_isAvailable(false), m_isPersistent(false)
+        { }
+
+        ~StreamingBuffer() {
+            Destroy();
+        }
+
+        bool Create(size_t regionSize = 4 * 1024 * 1024, int regionCount = 3);
+
+        void Destroy(void);
+
+        // requires an OpenGL context
+        inline void SetStreaming(bool isStreaming) {
+            m_isStreaming = isStreaming and (m_isAvailable or Create());
+        }
+
+        inline bool IsStreaming(void) {
+            return m_isStreaming;
+        }
+
+        inline bool IsPersistent(void) {
+            return m_isPersistent;
+        }
+
+        inline GLuint Handle(void) {
+            return m_handle;
+        }
+
+        inline const StreamStats& GetStats(void) {
+            return m_stats;
+        }
+
+        inline void ResetStats(void) {
+            m_stats = StreamStats();
+        }
+
+        // Copy dataSize bytes of data to the ring. offset receives their position in the buffer.
+        // Returns false if the data is larger than a region.
+        bool Allocate(const void* data, size_t dataSize, size_t& offset);
+
+        // fence the current region and move on to the next one. Call once per frame after the frame's draw calls.
+        void Update(void);
+
+        // print the stream statistics collected since the last reset
+        void ReportStats(void);
+
+    private:
+        inline int RegionCount(void) {
+            return int(m_fences.Length());
+        }
+
+        void NextRegion(void);
+
+        void WaitForRegion(int region);
+};
+
+#define streamingBuffer StreamingBuffer::Instance()
+
+// =================================================================================================
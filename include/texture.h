@@ -2,6 +2,9 @@
 
 #include "std_defines.h"
 
+#include <memory>
+#include <vector>
+
 #include "glew.h"
 #include "array.hpp"
 #include "string.hpp"
@@ -9,6 +12,9 @@
 #include "conversions.hpp"
 #include "sharedpointer.hpp"
 #include "sharedglhandle.hpp"
+#include "texturefile.h"
+#include "texturebindings.h"
+#include "samplercache.h"
 
 #include "SDL.h"
 #include "SDL_image.h"
@@ -65,6 +71,15 @@ class AbstractTexture {
     {
         public:
 
+        // dirty rectangle in pixels; right and bottom are exclusive
+        struct DirtyRect {
+            int left, top, right, bottom;
+
+            inline int Area(void) const {
+                return (right - left) * (bottom - top);
+            }
+        };
+
         class TextureBufferInfo {
         public:
             int                 width;
@@ -94,13 +109,25 @@ class AbstractTexture {
 #else
         char*               m_data;
 #endif
+        // texture data mapped from a cooked texture file instead of m_data. m_source keeps the mapping alive.
+        std::shared_ptr<TextureFile>    m_source;
+        const char*         m_mappedData;
+        int                 m_levelCount; // > 1: the texture data contains a precomputed mip chain
+        std::vector<char>   m_encodedData; // image file contents, kept for Texture::Residency::KeepCompressed
+        std::vector<DirtyRect>  m_dirtyRects; // regions changed since the texture has last been updated
+
+        static constexpr int maxDirtyRects = 8;
+
+        static inline bool  expandRGB{ false };         // store RGB images as RGBA
+        static inline bool  premultiplyAlpha{ false };  // premultiply color by alpha when loading RGBA images
+        static inline bool  gammaCorrectMipMaps{ true }; // filter mip levels in linear light; see PixelKernels::DownsampleRow
 #ifdef _DEBUG
         String              m_name;
 #endif
         //int     m_isAlias;
 
         TextureBuffer () 
-            : m_data ()//, m_isAlias (false)
+            : m_data (), m_mappedData(nullptr), m_levelCount(1)//, m_isAlias (false)
         {}
 
         ~TextureBuffer () {
@@ -136,6 +163,57 @@ class AbstractTexture {
 
         TextureBuffer& Move(TextureBuffer& other);
 
+        // use image imageIndex of a cooked texture file
+        TextureBuffer& Map(std::shared_ptr<TextureFile> source, int imageIndex);
+
+        inline const char* Data(void) {
+            return m_mappedData ? m_mappedData : (const char*)m_data;
+        }
+
+        // size of the texture data incl. mip levels
+        inline size_t DataSize(void) {
+            return TextureFile::ChainSize(m_info.width, m_info.height, m_info.componentCount, m_levelCount, IsCompressed());
+        }
+
+        inline bool IsCompressed(void) {
+            return (m_info.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) or (m_info.internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+        }
+
+        // compute the full mip chain on the CPU; the worker pool filters large levels. Returns true if the buffer has a mip chain.
+        bool CreateMipChain(void);
+
+        // replace the pixel data by S3TC blocks incl. a full mip chain
+        bool Compress(void);
+
+        // Add a changed region. Regions are merged with existing ones when that doesn't upload a lot of unchanged
+        // pixels, and there are never more than maxDirtyRects of them.
+        void MarkDirty(int x, int y, int width, int height);
+
+        // copy pixels (with componentCount bytes per pixel, pitch 0: tightly packed) to a region of the texture data and mark it dirty.
+        // Only works for uncompressed texture data.
+        bool Write(int x, int y, int width, int height, const void* pixels, int pitch = 0);
+
+        inline bool IsDirty(void) {
+            return not m_dirtyRects.empty();
+        }
+
+        inline void ClearDirtyRects(void) {
+            m_dirtyRects.clear();
+        }
+
+        inline bool HasData(void) {
+            return Data() != nullptr;
+        }
+
+        // free the pixel data but keep the buffer info
+        void ReleaseData(void);
+
+        // recreate the pixel data from m_encodedData
+        bool Decode(bool flipVertically);
+
+        // system memory held by this buffer
+        size_t ResidentSize(void);
+
         // CTextureBuffer(CTextureBuffer&& other) = default;            // move construct
 
         // CTextureBuffer& operator=(CTextureBuffer and other) = default; // move assignment
@@ -154,6 +232,24 @@ class AbstractTexture {
     class Texture : public AbstractTexture 
     {
     public:
+        // What happens to the CPU side copy of the texture data once it has been uploaded.
+        // Keep: keep it. Drop: free it. KeepCompressed: only keep the image file contents, which are a lot smaller.
+        // Dropped texture data is reloaded from its source when needed again (e.g. by Deploy). Textures without
+        // a source file (e.g. created from an SDL surface) always keep their texture data.
+        enum class Residency {
+            Keep,
+            Drop,
+            KeepCompressed
+        };
+
+        // immutable storage (glTexStorage*) allocated for the current handle; levels == 0: mutable storage
+        struct TextureStorage {
+            int     width = 0;
+            int     height = 0;
+            int     levels = 0;
+            GLenum  internalFormat = 0;
+        };
+
 #if USE_SHARED_HANDLES
         SharedTextureHandle     m_handle;
 #else
@@ -165,10 +261,27 @@ class AbstractTexture {
         int                     m_type;
         int                     m_wrapMode;
         int                     m_useMipMaps;
+        int                     m_pendingUploads{ 0 }; // number of buffers queued for streaming upload
+        TextureStorage          m_storage;
+        Residency               m_residency{ defaultResidency };
+        uint32_t                m_lastUsed{ 0 }; // frame in which the texture has last been bound
+        int                     m_tmu{ 0 }; // texture unit the texture has last been enabled on
+        int                     m_deployedBuffer{ 0 }; // texture buffer the GL texture has last been deployed from
+        SamplerState            m_samplerState;
+        GLuint                  m_sampler{ 0 }; // sampler object for m_samplerState
+        bool                    m_isEvicted{ false }; // GL texture has been freed to stay within the texture memory budget
+        bool                    m_isFlipped{ false }; // texture data has been flipped vertically when loading it
+        bool                    m_hasDirtyRegions{ false }; // the deployed texture buffer has regions changed by Write() which haven't been uploaded yet
+        bool                    m_parallelDecode{ false }; // decode the image files of a multi image texture (cubemap) in parallel
         bool                    m_hasBuffer;
         bool                    m_isValid;
 
         static SharedTextureHandle nullHandle;
+        static inline bool      useImmutableStorage{ false };
+        static inline bool      compressTextures{ false };
+        static inline bool      useCpuMipMaps{ false };
+        static inline Residency defaultResidency{ Residency::Keep };
+        static inline uint32_t  currentFrame{ 1 }; // advanced by TextureHandler::Update()
 
         Texture (GLuint handle = 0, int type = GL_TEXTURE_2D, int wrapMode = GL_CLAMP_TO_EDGE) 
             : m_handle(handle), m_type(type), m_wrapMode(wrapMode), m_useMipMaps(false), m_isValid(true), m_hasBuffer(false)
@@ -229,22 +342,96 @@ class AbstractTexture {
 
         void Wrap(void);
 
+        // set texture parameters unless they have already been set for the current handle or sampler objects are used
+        void ApplyParams(void);
+
+        // how the texture wants to be sampled
+        virtual SamplerState GetSamplerState(void);
+
+        // sampler object for the current sampler state
+        GLuint GetSampler(void);
+
+        bool AllocateStorage(int width, int height, GLenum internalFormat);
+
+        // upload texture data to level 0 of target; the texture must be bound
+        void UploadImage(GLenum target, TextureBuffer* texBuf, const void* data);
+
+        // the texture must be bound
+        void GenerateMipMaps(void);
+
+        // Write pixels to a texture buffer of a 2D texture. The changes are uploaded the next time the texture is enabled.
+        // Dynamic textures should keep their texture data (Residency::Keep).
+        bool Write(int x, int y, int width, int height, const void* pixels, int pitch = 0, int bufferIndex = 0);
+
+        // upload a region of texture buffer bufferIndex to a deployed 2D texture with glTexSubImage2D
+        bool UpdateRegion(int x, int y, int width, int height, int bufferIndex = 0);
+
+        // upload the dirty regions of texture buffer bufferIndex (-1: of the deployed buffer) and update the mip maps. Regions
+        // that couldn't be uploaded stay dirty. Returns the number of uploads.
+        int UpdateDirtyRegions(int bufferIndex = -1);
+
         virtual void Enable(int tmu = 0);
 
         virtual void Disable(void);
 
+        // enable textures on consecutive texture units starting at firstTmu
+        static void EnableTextures(TextureList& textures, int firstTmu = 0);
+
         virtual void Deploy(int bufferIndex = 0);
 
         virtual bool Load(List<String>& fileNames, bool flipVertically);
 
+        // load the cooked texture file of fileNames if there is one
+        bool LoadCooked(List<String>& fileNames, bool flipVertically);
+
+        TextureBuffer* LoadImage(String& fileName, bool flipVertically);
+
         bool CreateFromFile(List<String>& fileNames, bool flipVertically = false);
 
+        // apply the residency policy after the texture data has been uploaded
+        void ApplyResidency(void);
+
+        // reload texture data released by ApplyResidency
+        bool RestoreData(void);
+
+        bool IsResident(void);
+
+        // system memory held by the texture data
+        size_t ResidentSize(void);
+
+        // free the GL texture, but keep everything required to recreate it
+        bool Evict(void);
+
+        // recreate the GL texture of an evicted texture
+        bool Restore(void);
+
+        bool CanEvict(void);
+
+        inline bool IsEvicted(void) {
+            return m_isEvicted;
+        }
+
+        inline void SetResidency(Residency residency) {
+            m_residency = residency;
+        }
+
+        inline Residency GetResidency(void) {
+            return m_residency;
+        }
+
+        static inline void SetDefaultResidency(Residency residency) {
+            defaultResidency = residency;
+        }
+
         bool CreateFromSurface(SDL_Surface* surface, bool flipVertically = false);
 
         inline size_t TextureCount(void) {
             return m_buffers.Length();
         }
 
+        // estimated GPU memory footprint of the texture data
+        size_t MemorySize(void);
+
         inline int GetWidth(int i = 0) {
             return m_buffers[i]->m_info.width;
         }
@@ -273,13 +460,74 @@ class AbstractTexture {
             return m_hasBuffer;
         }
 
+        inline GLuint GetHandle(void) {
+#if USE_SHARED_HANDLES
+            return m_handle.get();
+#else
+            return m_handle;
+#endif
+        }
+
+        inline bool HasImmutableStorage(void) {
+            return m_storage.levels > 0;
+        }
+
+        // immutable storage requires OpenGL 4.2 or ARB_texture_storage
+        static inline bool HaveImmutableStorage(void) {
+            return GLEW_VERSION_4_2 or GLEW_ARB_texture_storage;
+        }
+
+        static inline bool UseImmutableStorage(void) {
+            return useImmutableStorage and HaveImmutableStorage();
+        }
+
+        static inline void SetImmutableStorage(bool immutableStorage) {
+            useImmutableStorage = immutableStorage;
+        }
+
+        // S3TC compression requires EXT_texture_compression_s3tc; without it, textures stay uncompressed
+        static inline bool HaveCompression(void) {
+            return GLEW_EXT_texture_compression_s3tc;
+        }
+
+        static inline bool UseCompression(void) {
+            return compressTextures and HaveCompression();
+        }
+
+        // compress textures loaded from image files from now on
+        static inline void SetCompression(bool compress) {
+            compressTextures = compress;
+        }
+
+        // Compute the mip chains of textures loaded from image files when loading them instead of having OpenGL generate
+        // them when deploying them. With parallel loading, this moves the cost of mip mapping off the render thread.
+        static inline void SetCpuMipMaps(bool cpuMipMaps) {
+            useCpuMipMaps = cpuMipMaps;
+        }
+
+        static inline int MipLevelCount(int width, int height) {
+            int levels = 1;
+            for (int size = (width > height) ? width : height; size > 1; size >>= 1)
+                ++levels;
+            return levels;
+        }
+
+        static GLenum SizedFormat(GLenum internalFormat);
+
         inline static void Release(int tmuIndex) {
-            glActiveTexture(GL_TEXTURE0 + tmuIndex);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glActiveTexture(GL_TEXTURE0); // always reset!
+            textureBindings.Bind(tmuIndex, GL_TEXTURE_2D, 0);
         }
 
         static tRenderOffsets ComputeOffsets(int w, int h, int viewportWidth, int viewportHeight, int renderAreaWidth, int renderAreaHeight);
+
+    private:
+        void ReleaseHandle(void);
+
+        void DeleteBuffers(void);
+
+        void PrepareBuffer(TextureBuffer* texBuf);
+
+        static bool ReadFile(String& fileName, std::vector<char>& data);
     };
 
 // =================================================================================================
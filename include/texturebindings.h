@@ -0,0 +1,115 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "glew.h"
+#include "singletonbase.hpp"
+#include "samplercache.h"
+
+// =================================================================================================
+// Shadow copy of the textures bound to each texture unit, so that binding a texture which is already bound
+// and switching to the already active texture unit don't cost GL calls.
+// Releasing a texture only marks its unit as released; the texture is actually unbound when another texture
+// is bound to that unit or when Flush() is called, which happens before rendering to an FBO, so that an FBO
+// never renders to a texture that is still bound.
+// All texture binding has to go through this class, otherwise the shadow copy gets out of sync. If external
+// code binds textures, call Invalidate() afterwards.
+// The class also remembers the sampling parameters applied to each texture object where sampler objects are
+// not available. These belong to the texture object rather than to the Texture using it, and a deleted
+// texture object's name may be reused, so they are dropped together with its bindings in Forget().
+
+class TextureBindings
+    : public BaseSingleton<TextureBindings>
+{
+    public:
+        static constexpr int maxUnits = 32;
+
+        struct TextureUnit {
+            GLenum  target = 0;
+            GLuint  handle = 0;
+            GLuint  sampler = 0;
+            bool    isReleased = false;
+            bool    isKnown = true;
+            bool    isSamplerKnown = true;
+        };
+
+        struct BindStats {
+            int     bindCount = 0;          // glBindTexture(s) calls issued
+            int     skipCount = 0;          // binds skipped because the texture was already bound
+            int     multiBindCount = 0;     // glBindTextures calls among bindCount
+            int     samplerBindCount = 0;   // glBindSampler(s) calls issued
+        };
+
+        TextureUnit     m_units[maxUnits];
+        int             m_activeUnit;
+        BindStats       m_stats;
+        BindStats       m_frameStats; // stats of the previous frame
+        std::unordered_map<GLuint, SamplerState>    m_textureParams; // parameters applied to texture objects, by handle
+
+        TextureBindings()
+            : m_activeUnit(0)
+        { }
+
+        void SetActiveUnit(int tmu);
+
+        inline int ActiveUnit(void) {
+            if (m_activeUnit < 0)
+                SetActiveUnit(0);
+            return m_activeUnit;
+        }
+
+        // Makes tmu the active unit, even if handle is bound to it already. handle 0 unbinds immediately.
+        void Bind(int tmu, GLenum target, GLuint handle);
+
+        // bind handles[i] to unit firstUnit + i. Uses a single glBindTextures call where available (ARB_multi_bind).
+        void Bind(int firstUnit, int count, const GLenum* targets, const GLuint* handles);
+
+        void BindSampler(int tmu, GLuint sampler);
+
+        void BindSamplers(int firstUnit, int count, const GLuint* samplers);
+
+        // mark a texture as not needed on its unit anymore
+        void Release(int tmu, GLenum target, GLuint handle);
+
+        // unbind all released textures
+        void Flush(void);
+
+        // GL unbinds deleted textures, so units still holding handle are free now. Also forgets the texture's parameters.
+        void Forget(GLuint handle);
+
+        inline bool HaveParams(GLuint handle, const SamplerState& state) {
+            auto it = m_textureParams.find(handle);
+            return (it != m_textureParams.end()) and (it->second == state);
+        }
+
+        inline void SetParams(GLuint handle, const SamplerState& state) {
+            m_textureParams[handle] = state;
+        }
+
+        // sampler objects have been deleted
+        void ForgetSamplers(void);
+
+        // texture bindings have been changed outside of this class
+        void Invalidate(void);
+
+        // call once per frame
+        void Update(void);
+
+        inline const BindStats& GetStats(void) {
+            return m_frameStats;
+        }
+
+        static inline bool HaveMultiBind(void) {
+            return GLEW_VERSION_4_4 or GLEW_ARB_multi_bind;
+        }
+
+    private:
+        inline bool IsBound(int tmu, GLenum target, GLuint handle) {
+            TextureUnit& unit = m_units[tmu];
+            return unit.isKnown and (unit.target == target) and (unit.handle == handle);
+        }
+};
+
+#define textureBindings TextureBindings::Instance()
+
+// =================================================================================================
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "string.hpp"
+#include "list.hpp"
+
+// =================================================================================================
+// Read only memory mapping of an entire file
+
+class MappedFile {
+    private:
+        const char* m_data;
+        size_t      m_size;
+#ifdef _WIN32
+        void*       m_file;
+        void*       m_mapping;
+#endif
+
+    public:
+        MappedFile()
+            : m_data(nullptr), m_size(0)
+#ifdef _WIN32
+            , m_file(nullptr), m_mapping(nullptr)
+#endif
+        { }
+
+        ~MappedFile() {
+            Close();
+        }
+
+        MappedFile(const MappedFile&) = delete;
+
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool Open(const char* fileName);
+
+        void Close(void);
+
+        inline const char* Data(void) {
+            return m_data;
+        }
+
+        inline size_t Size(void) {
+            return m_size;
+        }
+
+        inline bool IsOpen(void) {
+            return m_data != nullptr;
+        }
+};
+
+// =================================================================================================
+// Precooked texture container
+// Cooking converts image files offline into texture data that can be handed to OpenGL as is: Already flipped,
+// tightly packed RGB(A) bytes or S3TC blocks (BC1 for RGB, BC3 for RGBA), optionally with a precomputed mip chain. Texture::Load maps a cooked file and
+// uploads straight from the mapping, skipping image decoding and pixel conversion. If there is no (matching)
+// cooked file, textures are loaded from the image files with SDL_image. A cooked file only matches as long as its
+// source image files keep the modification time and size they had when it was cooked.
+// File layout:
+//   Header
+//   uint32_t     imageIndex[bufferCount]   image used for each texture buffer (e.g. cubemap face)
+//   SourceStamp  sources[bufferCount]      modification time and size of the source image files (unaligned)
+//   char         names[nameTableSize]      zero terminated base names of the source image files
+//   images                             each image holds levelCount mip levels, 16 byte aligned
+// The cooked file of a single image "name.png" is "name.rtx"; the cooked file of a multi image texture (e.g. a
+// cubemap) is named after its first image and the image count, e.g. "name-6.rtx".
+
+class TextureFile {
+    public:
+        struct Header {
+            char        magic[4];
+            uint32_t    version;
+            uint32_t    width;
+            uint32_t    height;
+            uint32_t    componentCount;
+            uint32_t    levelCount;     // 1: no mip chain
+            uint32_t    imageCount;     // distinct images in the file
+            uint32_t    bufferCount;    // texture buffers referencing these images
+            uint32_t    isFlipped;
+            uint32_t    nameTableSize;
+            uint32_t    isCompressed;   // images hold S3TC blocks
+        };
+
+        struct SourceStamp {
+            uint64_t    modTime;        // seconds; 0 for empty file names and missing files
+            uint64_t    size;
+        };
+
+        static constexpr char       magic[4] = { 'R', 'T', 'T', 'X' };
+        static constexpr uint32_t   version = 3;
+        static constexpr uint32_t   maxImageSize = 65536; // width and height
+
+        MappedFile          m_file;
+        const Header*       m_header;
+        const uint32_t*     m_imageIndices;
+        const char*         m_sources;
+        const char*         m_names;
+        const char*         m_images;
+
+        TextureFile()
+            : m_header(nullptr), m_imageIndices(nullptr), m_sources(nullptr), m_names(nullptr), m_images(nullptr)
+        { }
+
+        // map and validate a cooked file. Fails silently if the file doesn't exist.
+        bool Open(String fileName);
+
+        // check whether the file was cooked from fileNames in their current state with the same vertical flipping
+        bool Matches(List<String>& fileNames, bool flipVertically);
+
+        static SourceStamp GetSourceStamp(const char* fileName);
+
+        inline int BufferCount(void) {
+            return int(m_header->bufferCount);
+        }
+
+        inline int ImageIndex(int bufferIndex) {
+            return int(m_imageIndices[bufferIndex]);
+        }
+
+        inline const char* ImageData(int imageIndex) {
+            return m_images + imageIndex * AlignedSize(ChainSize(m_header->width, m_header->height, m_header->componentCount, m_header->levelCount, m_header->isCompressed != 0));
+        }
+
+        static String CookedFileName(List<String>& fileNames);
+
+        // Load fileNames with SDL_image and write the cooked file next to the first of them. All images must have
+        // the same size. Empty file names reuse the previous image like in Texture::Load. compress stores S3TC blocks,
+        // which can only be used where OpenGL supports EXT_texture_compression_s3tc.
+        static bool Cook(List<String>& fileNames, bool flipVertically = false, bool createMipMaps = true, bool compress = false);
+
+        static size_t LevelSize(int width, int height, int componentCount, bool isCompressed = false);
+
+        // size of levelCount tightly packed mip levels
+        static size_t ChainSize(int width, int height, int componentCount, int levelCount, bool isCompressed = false);
+
+        // chain holds level 0 of an image; compute levels 1 .. levelCount - 1 behind it with a 2x2 box filter
+        static void CreateMipChain(uint8_t* chain, int width, int height, int componentCount, int levelCount, bool gammaCorrect);
+
+        static inline size_t AlignedSize(size_t size) {
+            return (size + 15) & ~size_t(15);
+        }
+};
+
+// =================================================================================================
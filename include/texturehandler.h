@@ -4,6 +4,7 @@
 #include "texture.h"
 #include "cubemap.h"
 #include "list.hpp"
+#include "dictionary.hpp"
 #include "sharedpointer.hpp"
 #include "singletonbase.hpp"
 
@@ -12,18 +13,72 @@
 // Main purpose is to keep track of all texture objects in the game and return them to OpenGL in
 // a well defined and controlled way at program termination without having to bother about releasing
 // textures at a dozen places in the game
+// Textures created from files are cached by file names, vertical flipping and texture type, so
+// requesting the same texture again returns the already loaded texture. Cached textures are reference
+// counted; Release() frees a texture when its last user has released it.
 
 class TextureHandler 
     : public BaseSingleton<TextureHandler>
 {
     public:
-        TextureList m_textures;
+        // timing of the most recent Create* call; see BenchmarkLoading()
+        struct LoadStats {
+            int     textureCount = 0;
+            float   loadTime = 0.0f; // seconds
+            bool    isParallel = false;
+        };
+
+        struct CacheEntry {
+            Texture*    texture = nullptr;
+            int         refCount = 0;
+            int         hitCount = 0;
+        };
+
+        struct CacheStats {
+            int         hitCount = 0;
+            int         missCount = 0;
+            size_t      bytesSaved = 0; // texture data that didn't need to be loaded and uploaded again
+        };
+
+        struct MemoryStats {
+            size_t      cpuBytes = 0; // texture data resident in system memory, see Texture::Residency
+            size_t      gpuBytes = 0; // estimated
+            size_t      gpuBudget = 0;
+            int         evictionCount = 0; // textures evicted so far to stay within the budget
+        };
+
+        TextureList                     m_textures;
+        Dictionary<String, CacheEntry>  m_textureCache;
+        Dictionary<Texture*, String>    m_cacheKeys;
+        CacheStats                      m_cacheStats; // bytesSaved only covers textures already removed from the cache
+        LoadStats                       m_loadStats;
+        size_t                          m_gpuBudget; // 0: unlimited
+        int                             m_evictionCount;
+        bool                            m_parallelLoading;
+        bool                            m_useTextureCache;
+
+        static inline bool              isAvailable{ false }; // false after the texture handler has been destroyed
 
         typedef Texture* (*tGetter) (void);
 
-        TextureHandler() = default;
-
-        ~TextureHandler() { Destroy (); }
+        TextureHandler()
+            : m_gpuBudget(0), m_evictionCount(0), m_parallelLoading(false), m_useTextureCache(true)
+        { 
+#if !(USE_STD || USE_STD_MAP)
+            m_textureCache.SetComparator(String::Compare);
+            m_cacheKeys.SetComparator(TextureHandler::CompareTextures);
+#endif
+            isAvailable = true;
+        }
+
+        ~TextureHandler() { 
+            Destroy ();
+            isAvailable = false;
+        }
+
+        static int CompareTextures(void* context, Texture* const& key1, Texture* const& key2) {
+            return (key1 < key2) ? -1 : (key1 > key2) ? 1 : 0;
+        }
 
         void Destroy(void);
 
@@ -33,14 +88,61 @@ class TextureHandler
 
         bool Remove(Texture* texture);
 
-        TextureList Create(String textureFolder, List<String>& textureNames, GLenum textureType);
+        // release a reference to a texture; deletes it when it isn't referenced anymore
+        bool Release(Texture* texture);
+
+        // flipped and unflipped textures loaded from the same files are cached separately
+        TextureList Create(String textureFolder, List<String>& textureNames, GLenum textureType, bool flipVertically = false);
+
+        TextureList CreateTextures(String textureFolder, List<String>& textureNames, bool flipVertically = false);
+
+        TextureList CreateCubemaps(String textureFolder, List<String>& textureNames, bool flipVertically = false);
+
+        TextureList CreateByType(String textureFolder, List<String>& textureNames, GLenum textureType, bool flipVertically = false);
+
+        // batch load mode: decode image files on the worker pool and deploy them on the calling (GL) thread 
+        // in the order the workers finish them. The resulting texture list is the same as with serial loading.
+        inline void SetParallelLoading(bool parallelLoading) {
+            m_parallelLoading = parallelLoading;
+        }
+
+        inline const LoadStats& GetLoadStats(void) {
+            return m_loadStats;
+        }
+
+        inline void SetTextureCache(bool useTextureCache) {
+            m_useTextureCache = useTextureCache;
+        }
+
+        CacheStats GetCacheStats(void);
+
+        MemoryStats GetMemoryStats(void);
+
+        // Limit the estimated GPU memory used by textures. When over budget, the least recently used textures are
+        // evicted; they are transparently recreated the next time they are enabled or bound.
+        inline void SetMemoryBudget(size_t gpuBudget) {
+            m_gpuBudget = gpuBudget;
+        }
+
+        // advance the frame counter used for LRU tracking and enforce the memory budget. Call once per frame.
+        void Update(void);
+
+        // load the given textures serially and in parallel and print both load times
+        void BenchmarkLoading(String textureFolder, List<String>& textureNames, GLenum textureType = GL_TEXTURE_2D);
+
+        // load one cubemap from faceNames with serial and parallel face decoding and print both load times
+        void BenchmarkCubemap(String textureFolder, List<String>& faceNames);
+
+    private:
+        void EnforceBudget(void);
 
-        TextureList CreateTextures(String textureFolder, List<String>& textureNames);
+        String CacheKey(List<String>& fileNames, GLenum textureType, bool flipVertically);
 
-        TextureList CreateCubemaps(String textureFolder, List<String>& textureNames);
+        TextureList CreateCached(List<List<String>>& fileNames, GLenum textureType, bool flipVertically = false);
 
-        TextureList CreateByType(String textureFolder, List<String>& textureNames, GLenum textureType);
+        TextureList LoadTextures(TextureList& textures, List<List<String>>& fileNames, bool flipVertically, int& failedIndex);
 
+        TextureList LoadBatch(TextureList& textures, List<List<String>>& fileNames, bool flipVertically, int& failedIndex);
 };
 
 #define textureHandler TextureHandler::Instance()
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <deque>
+
+#include "glew.h"
+#include "array.hpp"
+#include "texture.h"
+#include "singletonbase.hpp"
+
+// =================================================================================================
+// Streaming texture upload through a ring of pixel unpack buffers (PBOs).
+// In streaming mode, Texture::Deploy only queues its texture data here. Once per frame, Update()
+// copies queued texture data into the next free PBO of the ring and has OpenGL read the texture
+// data from there, so the driver can transfer it asynchronously while the frame is being rendered.
+// Each PBO is guarded by a fence, so a PBO the GPU is still reading from is never overwritten;
+// instead, the upload is postponed to the next frame. The amount of texture data uploaded per frame
+// is limited by a byte budget to avoid frame time spikes when loading many textures at once.
+// Only needs OpenGL 2.1 PBOs (fences need OpenGL 3.2 or ARB_sync; without them, PBOs get orphaned
+// before reuse instead), so it should also work with software drivers like llvmpipe. This hasn't been
+// tested headless on llvmpipe yet.
+
+class TextureUploader
+    : public BaseSingleton<TextureUploader>
+{
+    public:
+        struct UploadRequest {
+            Texture*        texture;
+            TextureBuffer*  buffer;
+            GLenum          target;
+            int             faceCount; // number of consecutive cubemap faces starting at target sharing buffer
+        };
+
+        struct PixelBuffer {
+            GLuint          handle = 0;
+            GLsync          fence = nullptr;
+            size_t          capacity = 0;
+        };
+
+        struct UploadStats {
+            size_t          bytesUploaded = 0;
+            int             uploadCount = 0;
+            int             stallCount = 0; // uploads postponed because the next PBO was still in use
+        };
+
+        ManagedArray<PixelBuffer>   m_pixelBuffers;
+        std::deque<UploadRequest>   m_requests;
+        int                         m_currentBuffer;
+        size_t                      m_frameBudget;
+        UploadStats                 m_stats;
+        bool                        m_isStreaming;
+        bool                        m_isAvailable;
+        bool                        m_haveFences;
+
+        TextureUploader()
+            : m_currentBuffer(0), m_frameBudget(4 * 1024 * 1024), m_isStreaming(false), m_isAvailable(false), m_haveFences(false)
+        { }
+
+        ~TextureUploader() {
+            Destroy();
+        }
+
+        bool Create(int bufferCount = 3);
+
+        void Destroy(void);
+
+        // requires an OpenGL context
+        inline void SetStreaming(bool isStreaming) {
+            m_isStreaming = isStreaming and (m_isAvailable or Create());
+        }
+
+        inline bool IsStreaming(void) {
+            return m_isStreaming;
+        }
+
+        inline void SetFrameBudget(size_t frameBudget) {
+            m_frameBudget = frameBudget;
+        }
+
+        inline bool HavePendingUploads(void) {
+            return not m_requests.empty();
+        }
+
+        inline const UploadStats& GetStats(void) {
+            return m_stats;
+        }
+
+        void Enqueue(Texture* texture, GLenum target, TextureBuffer* buffer, int faceCount = 1);
+
+        // drop all pending uploads of texture (e.g. because it is being destroyed)
+        void Cancel(Texture* texture);
+
+        // upload queued texture data within the per frame budget. Call once per frame.
+        void Update(void);
+
+        // upload all queued texture data now, regardless of the frame budget
+        void Flush(void);
+
+    private:
+        bool WaitForBuffer(PixelBuffer& pbo, bool wait);
+
+        bool Upload(UploadRequest& request, bool wait);
+
+        bool Stage(UploadRequest& request, bool wait);
+};
+
+#define textureUploader TextureUploader::Instance()
+
+// =================================================================================================
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdio.h>
+
 #include "glew.h"
 #include "list.hpp"
 #include "sharedglhandle.hpp"
@@ -24,6 +26,11 @@
 // fixed sequence: vertices, colors, ...
 // TODO: Expand shader for all kinds of inputs (texture coordinates, normals)
 // See also https://qastack.com.de/programming/8704801/glvertexattribpointer-clarification
+//
+// Disabling a VAO doesn't unbind it. The VAO binding is shadowed, and a VAO is only bound when a different
+// one is needed, so consecutive draws with the same VAO don't rebind it. Therefore all code must bind VAOs
+// through BindVertexArray(), and nothing may modify the element array buffer binding without having bound
+// the VAO it wants to modify.
 
 #ifdef USE_SHARED_HANDLES
 #   undef USE_SHARED_HANDLES
@@ -43,13 +50,24 @@ class VAO
 #endif
         GLuint              m_shape;
         bool                m_isDynamic;
-        bool                m_isBound;
+        bool                m_isStreamed;
+
+        struct BindStats {
+            int bindCount = 0;  // glBindVertexArray calls issued
+            int skipCount = 0;  // binds skipped because the VAO was bound already
+        };
+
+        static constexpr int maxStackDepth = 16;
 
         static VAO*         activeVAO;
-        static List<VAO*>   vaoStack;
+        static VAO*         vaoStack[maxStackDepth];
+        static int          stackDepth;
+        static GLuint       boundHandle;    // shadow of OpenGL's vertex array binding
+        static BindStats    bindStats;      // counts of the current frame
+        static BindStats    frameBindStats; // counts of the last frame
 
         VAO(bool isDynamic = true)
-            : m_isDynamic(isDynamic), m_isBound(false), m_shape(0)
+            : m_isDynamic(isDynamic), m_isStreamed(false), m_shape(0)
 #if USE_SHARED_HANDLES
             , m_handle (SharedGLHandle(0, glGenVertexArrays, glDeleteVertexArrays))
 #else
@@ -60,17 +78,36 @@ class VAO
         }
 
         static inline void PushVAO(VAO* vao) {
-            vaoStack.Append(vao);
+            if (stackDepth < maxStackDepth)
+                vaoStack[stackDepth++] = vao;
+            else
+                fprintf(stderr, "VAO: activation stack overflow\n");
         }
 
         static inline VAO* PopVAO(void) {
-            if (not vaoStack.Length())
-                return nullptr;
-            VAO* vao;
-            vaoStack.Pop(vao);
-            return vao;
+            return stackDepth ? vaoStack[--stackDepth] : nullptr;
+        }
+
+        // bind handle unless it is bound already
+        static inline void BindVertexArray(GLuint handle) {
+            if (handle == boundHandle)
+                ++bindStats.skipCount;
+            else {
+                glBindVertexArray(handle);
+                boundHandle = handle;
+                ++bindStats.bindCount;
+            }
         }
 
+        // call once per frame; keeps the bind counts of the frame in frameBindStats
+        static inline void UpdateBindStats(void) {
+            frameBindStats = bindStats;
+            bindStats = BindStats();
+        }
+
+        // print the bind counts of the last frame
+        static void ReportBindStats(void);
+
         inline void SetDynamic(bool isDynamic) {
             m_isDynamic = isDynamic;
             for (auto vbo : m_dataBuffers)
@@ -78,6 +115,13 @@ class VAO
             m_indexBuffer.SetDynamic(m_isDynamic);
         }
 
+        // stream the vertex data through the streaming buffer (see VBO::SetStreamed()); index data is always uploaded
+        inline void SetStreamed(bool isStreamed) {
+            m_isStreamed = isStreamed;
+            for (auto vbo : m_dataBuffers)
+                vbo->SetStreamed(isStreamed);
+        }
+
         bool Init (GLuint shape);
 
         ~VAO () {
@@ -117,7 +161,7 @@ class VAO
         }
 
         inline bool IsBound(void) {
-            return IsValid() and m_isBound;
+            return IsValid() and (boundHandle == GLuint(m_handle));
         }
 
         inline bool IsActive(void) {
@@ -134,7 +178,7 @@ class VAO
         inline void Deactivate(void) {
             if (IsActive()) {
                 activeVAO = PopVAO();
-                if (activeVAO and activeVAO->IsBound())
+                if (activeVAO)
                     activeVAO->Enable();
             }
         }
@@ -160,7 +204,13 @@ class VAO
         // add a vertex or index data buffer
         bool UpdateBuffer(const char* type, void* data, size_t dataSize, size_t componentType, size_t componentCount = 0);
 
-        bool UpdateVertexBuffer(const char* type, void* data, size_t dataSize, size_t componentType, size_t componentCount);
+        // location is the attribute location; by default, buffers get consecutive locations in the order of their creation
+        // dirtyRanges: byte ranges of data that have changed; see VBO::Update()
+        bool UpdateVertexBuffer(const char* type, void* data, size_t dataSize, size_t componentType, size_t componentCount, int location = -1,
+                                const std::vector<BufferRange>* dirtyRanges = nullptr);
+
+        // add a buffer holding several interleaved vertex attributes as described by layout
+        bool UpdateInterleavedBuffer(const char* type, void* data, size_t dataSize, const VertexLayout& layout, const std::vector<BufferRange>* dirtyRanges = nullptr);
 
         void UpdateIndexBuffer(void* data, size_t dataSize, size_t componentType);
 
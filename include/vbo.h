@@ -1,7 +1,10 @@
 #pragma once
 
+#include <vector>
+
 #include "glew.h"
 //#include <string.h>
+#include "array.hpp"
 #include "sharedpointer.hpp"
 #include "sharedglhandle.hpp"
 
@@ -11,6 +14,63 @@
 
 #define USE_SHARED_HANDLES 1
 
+// =================================================================================================
+// Layout of interleaved vertex data: each vertex holds all attributes listed, at the given byte offsets.
+
+struct VertexAttrib {
+    const char* type;
+    int         index;          // attribute location
+    GLint       componentCount;
+    GLenum      componentType;
+    GLboolean   isNormalized;
+    GLsizei     offset;         // byte offset inside a vertex
+};
+
+
+class VertexLayout {
+    public:
+        ManagedArray<VertexAttrib>  m_attribs;
+        GLsizei                     m_stride;
+
+        VertexLayout()
+            : m_stride(0)
+        { }
+
+        // append an attribute behind the ones already added. Offsets are kept 4 byte aligned.
+        inline void Add(const char* type, int index, GLint componentCount, GLenum componentType, GLboolean isNormalized = GL_FALSE, GLsizei componentSize = 4) {
+            m_attribs.Append(VertexAttrib{ type, index, componentCount, componentType, isNormalized, m_stride });
+            m_stride += (componentCount * componentSize + 3) & ~3;
+        }
+
+        inline void Clear(void) {
+            m_attribs.Clear();
+            m_stride = 0;
+        }
+
+        inline bool IsEmpty(void) {
+            return m_attribs.IsEmpty();
+        }
+
+        bool Matches(VertexLayout& other) {
+            if ((m_stride != other.m_stride) or (m_attribs.Length() != other.m_attribs.Length()))
+                return false;
+            for (uint32_t i = 0; i < m_attribs.Length(); i++) {
+                VertexAttrib& a = m_attribs[i];
+                VertexAttrib& b = other.m_attribs[i];
+                if ((a.index != b.index) or (a.componentCount != b.componentCount) or (a.componentType != b.componentType) or
+                    (a.isNormalized != b.isNormalized) or (a.offset != b.offset))
+                    return false;
+            }
+            return true;
+        }
+};
+
+// byte range of a buffer
+struct BufferRange {
+    size_t  offset;
+    size_t  size;
+};
+
 // =================================================================================================
 // OpenGL vertex buffer handling: Creation, sending attributes to OpenGL, binding for rendering
 
@@ -33,6 +93,17 @@ class VBO
         GLint               m_componentCount;
         GLenum              m_componentType;
         bool                m_isDynamic;
+        bool                m_isStreamed;   // stream the data through the streaming buffer instead of uploading it to m_handle
+        bool                m_isInStream;   // the data currently lives in the streaming buffer ...
+        size_t              m_streamOffset; // ... at this offset
+        VertexLayout        m_layout;       // attributes of interleaved buffers; empty for buffers holding a single attribute
+
+        struct UploadStats {
+            size_t  uploadedBytes = 0;  // bytes actually sent to OpenGL
+            size_t  bufferBytes = 0;    // size of the buffers updated
+        };
+
+        static UploadStats  uploadStats;
 
         VBO(const char* type = "", GLint bufferType = GL_ARRAY_BUFFER, bool isDynamic = true);
 
@@ -72,31 +143,53 @@ class VBO
         }
 
         inline void EnableAttribs(void) {
+            for (auto& a : m_layout.m_attribs)
+                glEnableVertexAttribArray(a.index);
             if (m_index > -1)
                 glEnableVertexAttribArray(m_index);
         }
 
         inline void DisableAttribs(void) {
+            for (auto& a : m_layout.m_attribs)
+                glDisableVertexAttribArray(a.index);
             if (m_index > -1)
                 glDisableVertexAttribArray(m_index);
         }
 
         inline void Describe(void) {
-            if (m_index > -1) {
-                glVertexAttribPointer(m_index, m_componentCount, m_componentType, GL_FALSE, 0, nullptr);
-                EnableAttribs();
-            }
+            for (auto& a : m_layout.m_attribs)
+                glVertexAttribPointer(a.index, a.componentCount, a.componentType, a.isNormalized, m_layout.m_stride, (const GLvoid*)(m_streamOffset + size_t(a.offset)));
+            if (m_index > -1) // integer attributes are always read as normalized floats
+                glVertexAttribPointer(m_index, m_componentCount, m_componentType, IsIntegerType(m_componentType) ? GL_TRUE : GL_FALSE, 0, (const GLvoid*)m_streamOffset);
+            EnableAttribs();
         }
 
         // data: buffer with OpenGL data (float or unsigned int)
         // dataSize: buffer size in bytes
         // componentType: OpenGL type of OpenGL data components (GL_FLOAT or GL_UNSIGNED_INT)
         // componentCount: Number of components of the primitives represented by the render data (3 for 3D vectors, 2 for texture coords, 4 for color values, ...)
-        bool Update(const char* type, GLint bufferType, int index, void* data, size_t dataSize, size_t componentType, size_t componentCount = 1);
+        // For interleaved buffers, m_layout describes the attributes, and index and componentCount are ignored.
+        // dirtyRanges: if given, only these byte ranges of data have changed. They are uploaded instead of the entire
+        // data if the buffer is dynamic and its size and component type haven't changed.
+        // Streamed dynamic vertex buffers copy the data to the streaming buffer if it is active (see StreamingBuffer).
+        bool Update(const char* type, GLint bufferType, int index, void* data, size_t dataSize, size_t componentType, size_t componentCount = 1,
+                    const std::vector<BufferRange>* dirtyRanges = nullptr);
+
+        static inline void ResetUploadStats(void) {
+            uploadStats = UploadStats();
+        }
+
+        // print the bytes uploaded since the last reset compared to the size of the buffers updated
+        static void ReportUploadStats(void);
 
         void Destroy(void);
 
-        size_t ComponentSize (size_t componentType);
+        // bytes per component; a GL_INT_2_10_10_10_REV attribute has four components in four bytes
+        static size_t ComponentSize (size_t componentType);
+
+        static inline bool IsIntegerType(size_t componentType) {
+            return (componentType != GL_FLOAT) and (componentType != GL_HALF_FLOAT);
+        }
 
         inline bool IsType(const char* type) {
             return !strcmp(m_type, type);
@@ -105,6 +198,17 @@ class VBO
         inline void SetDynamic(bool isDynamic) {
             m_isDynamic = isDynamic;
         }
+
+        // Only for buffers that are updated each time before they are rendered, since their data in the streaming
+        // buffer gets overwritten after a few frames
+        inline void SetStreamed(bool isStreamed) {
+            m_isStreamed = isStreamed;
+        }
+
+    private:
+        void SetFormat(const char* type, GLint bufferType, size_t dataSize, size_t componentType, size_t componentCount);
+
+        bool Stream(const char* type, int index, void* data, size_t dataSize, size_t componentType, size_t componentCount);
 };
 
 // =================================================================================================
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "glew.h"
 #include "vector.hpp"
 #include "array.hpp"
@@ -13,16 +16,33 @@
 // Interface classes between python and OpenGL representations of rendering data
 // Supplies iterators, assignment and indexing operatores and transparent data conversion to OpenGL
 // ready format (Setup() method)
+// By default, app data is kept in a segmented list. In contiguous mode (SetContiguous()), it is kept in a single
+// reservable array instead. If the app data type consists of exactly m_componentCount GL values, that array already
+// has the layout OpenGL expects; Setup() then has nothing to do, and GLData() is a view of the app data.
+// In contiguous mode, where all writes go through Append() and operator[], the buffer also tracks which elements
+// have changed since the last upload (m_dirtyRanges), so that only these need to be copied and uploaded.
+
+// range [first, end) of app data elements
+struct ElementRange {
+    uint32_t    first;
+    uint32_t    end;
+};
+
 
 template < typename APP_DATA_T, typename GL_DATA_T>
 class VertexDataBuffer {
     public:
         SegmentedList<APP_DATA_T>   m_appData;
+        ManagedArray<APP_DATA_T>    m_contiguousData;   // app data in contiguous mode
         ManagedArray<GL_DATA_T>     m_glData;
         uint32_t                    m_componentCount;
+        bool                        m_isContiguous;
+        std::vector<ElementRange>   m_dirtyRanges;      // sorted, disjoint and not adjacent; contiguous mode only
+
+        static constexpr int maxDirtyRanges = 8;
 
         VertexDataBuffer(uint32_t componentCount = 1, size_t listSegmentSize = 1)
-            : m_componentCount (componentCount)
+            : m_componentCount (componentCount), m_isContiguous(false)
         {
 #if USE_SEGMENTED_LISTS
             m_appData = SegmentedList<APP_DATA_T>(listSegmentSize);
@@ -44,8 +64,11 @@ class VertexDataBuffer {
         VertexDataBuffer& Copy (VertexDataBuffer const& other) {
             if (this != &other) {
                 m_appData = other.m_appData;
+                m_contiguousData = other.m_contiguousData;
                 m_glData = other.m_glData;
                 m_componentCount = other.m_componentCount;
+                m_isContiguous = other.m_isContiguous;
+                m_dirtyRanges = other.m_dirtyRanges;
             }
             return *this;
         }
@@ -53,8 +76,11 @@ class VertexDataBuffer {
         VertexDataBuffer& Move(VertexDataBuffer& other) {
             if (this != &other) {
                 m_appData = std::move(other.m_appData);
+                m_contiguousData = std::move(other.m_contiguousData);
                 m_glData = std::move(other.m_glData);
                 m_componentCount = other.m_componentCount;
+                m_isContiguous = other.m_isContiguous;
+                m_dirtyRanges = std::move(other.m_dirtyRanges);
                 other.m_componentCount = 0;
             }
             return *this;
@@ -64,43 +90,196 @@ class VertexDataBuffer {
             m_glData = glData;
         }
 
-        virtual ManagedArray<GL_DATA_T>& Setup(void) = 0;
+        // switch between segmented and contiguous app data storage; existing app data is moved over
+        void SetContiguous(bool isContiguous) {
+            if (m_isContiguous == isContiguous)
+                return;
+            if (isContiguous) {
+                m_contiguousData.Resize(m_appData.Length());
+                APP_DATA_T* p = m_contiguousData.Data();
+                for (auto& v : m_appData)
+                    *p++ = v;
+                m_appData.Clear();
+            }
+            else {
+                for (auto& v : m_contiguousData)
+                    m_appData.Append(v);
+                m_contiguousData.Clear();
+            }
+            m_isContiguous = isContiguous;
+            m_dirtyRanges.clear();
+        }
+
+        inline bool IsContiguous(void) {
+            return m_isContiguous;
+        }
+
+        // reserve room for capacity app data elements (contiguous mode only)
+        inline void Reserve(size_t capacity) {
+            if (m_isContiguous)
+                m_contiguousData.reserve(capacity);
+        }
+
+        // true if the contiguous app data can directly be passed to OpenGL
+        inline bool IsPacked(void) {
+            return m_isContiguous and (sizeof(APP_DATA_T) == m_componentCount * sizeof(GL_DATA_T)) and not m_contiguousData.IsEmpty()
+                   and ((const void*)m_contiguousData.Data()->Data() == (const void*)m_contiguousData.Data());
+        }
+
+        // Add count elements starting at first to the dirty ranges. Overlapping and adjacent ranges are merged; beyond
+        // maxDirtyRanges, the two ranges with the smallest gap between them are merged.
+        void MarkDirty(uint32_t first, uint32_t count = 1) {
+            if (not m_isContiguous or (count == 0))
+                return;
+            ElementRange range = { first, first + count };
+            auto it = std::lower_bound(m_dirtyRanges.begin(), m_dirtyRanges.end(), range, [](const ElementRange& a, const ElementRange& b) { return a.end < b.first; });
+            // it is the first range ending at or behind range.first, i.e. the first one range may touch
+            while ((it != m_dirtyRanges.end()) and (it->first <= range.end)) {
+                range.first = std::min(range.first, it->first);
+                range.end = std::max(range.end, it->end);
+                it = m_dirtyRanges.erase(it);
+            }
+            m_dirtyRanges.insert(it, range);
+            if (int(m_dirtyRanges.size()) > maxDirtyRanges) {
+                size_t best = 0;
+                for (size_t i = 1; i < m_dirtyRanges.size() - 1; i++)
+                    if (m_dirtyRanges[i + 1].first - m_dirtyRanges[i].end < m_dirtyRanges[best + 1].first - m_dirtyRanges[best].end)
+                        best = i;
+                m_dirtyRanges[best].end = m_dirtyRanges[best + 1].end;
+                m_dirtyRanges.erase(m_dirtyRanges.begin() + best + 1);
+            }
+        }
+
+        // true if only the dirty ranges need to be uploaded; otherwise, all data has to be
+        inline bool HaveDirtyRanges(void) {
+            return not m_dirtyRanges.empty();
+        }
+
+        // call after the dirty ranges have been uploaded
+        inline void ClearDirtyRanges(void) {
+            m_dirtyRanges.clear();
+        }
+
+        // Create a densely packed array from the app data. With packed contiguous app data, there is nothing to do.
+        // If only some ranges of contiguous app data have changed, only these are copied.
+        virtual ManagedArray<GL_DATA_T>& Setup(void) {
+            if (not HaveAppData()) // the buffer only holds GL data (e.g. set directly or by SetGLData()), which is current
+                return m_glData;
+            if (IsPacked())
+                m_glData.Clear();
+            else if (m_isContiguous) {
+                if (HaveDirtyRanges() and (m_glData.Length() == AppDataLength() * m_componentCount)) {
+                    for (auto& r : m_dirtyRanges)
+                        CopyAppData(m_contiguousData, r.first, r.end);
+                }
+                else
+                    CopyAppData(m_contiguousData);
+            }
+            else
+                CopyAppData(m_appData);
+            return m_glData;
+        }
 
         operator GLvoid* () {
-            return (GLvoid*)m_glData.data();
+            return (GLvoid*)GLData();
         }
 
         inline uint32_t AppDataLength(void) {
-            return m_appData.Length();
+            return m_isContiguous ? m_contiguousData.Length() : m_appData.Length();
         }
 
         inline GL_DATA_T* GLData(void) {
-            return m_glData.Data();
+            return IsPacked() ? (GL_DATA_T*)m_contiguousData.Data() : m_glData.Data();
         }
 
         inline uint32_t GLDataLength(void) {
-            return m_glData.Length();
+            return IsPacked() ? m_contiguousData.Length() * m_componentCount : m_glData.Length();
         }
 
         inline uint32_t GLDataSize(void) {
-            return m_glData.Length() * sizeof(GL_DATA_T);
+            return GLDataLength() * sizeof(GL_DATA_T);
         }
 
         inline bool Append(APP_DATA_T data) {
-            return m_appData.Append(data);
+            if (not m_isContiguous)
+                return m_appData.Append(data);
+            MarkDirty(m_contiguousData.Length());
+            return m_contiguousData.Append(data);
         }
 
+        bool Append(SegmentedList<APP_DATA_T>& data) {
+            if (not m_isContiguous) {
+                m_appData += data;
+                return true;
+            }
+            MarkDirty(m_contiguousData.Length(), data.Length());
+            for (auto& v : data)
+                if (not m_contiguousData.Append(v))
+                    return false;
+            return true;
+        }
+
+        // Reorder the data: element i moves to remap[i], or is dropped if remap[i] is 0xFFFFFFFF. Elements mapped to the
+        // same position must be equal. The buffer ends up with newLength elements. If glDataIsCurrent is set, the GL data
+        // is remapped along with the app data instead of being set up from it again.
+        void Remap(const std::vector<uint32_t>& remap, uint32_t newLength, bool glDataIsCurrent = false) {
+            bool remapGLData = HaveGLData() and (glDataIsCurrent or not HaveAppData());
+            if (HaveAppData()) {
+                ManagedArray<APP_DATA_T> remapped;
+                remapped.Resize(newLength);
+                uint32_t i = 0;
+                if (m_isContiguous) {
+                    for (auto& v : m_contiguousData)
+                        if (remap[i++] != 0xFFFFFFFF)
+                            remapped[remap[i - 1]] = v;
+                    m_contiguousData = std::move(remapped);
+                }
+                else {
+                    for (auto& v : m_appData)
+                        if (remap[i++] != 0xFFFFFFFF)
+                            remapped[remap[i - 1]] = v;
+                    m_appData.Clear();
+                    for (auto& v : remapped)
+                        m_appData.Append(v);
+                }
+            }
+            if (remapGLData) {
+                ManagedArray<GL_DATA_T> remapped;
+                remapped.Resize(size_t(newLength) * m_componentCount);
+                for (uint32_t i = 0; i < m_glData.Length() / m_componentCount; i++)
+                    if (remap[i] != 0xFFFFFFFF)
+                        memcpy(remapped.Data() + size_t(remap[i]) * m_componentCount, m_glData.Data() + size_t(i) * m_componentCount, m_componentCount * sizeof(GL_DATA_T));
+                m_glData = std::move(remapped);
+            }
+            else
+                m_glData.Clear();
+            m_dirtyRanges.clear();
+            if (not remapGLData)
+                Setup();
+        }
+
+        // in contiguous mode, the element accessed is considered changed
         inline APP_DATA_T& operator[] (const int32_t i) {
-            return m_appData[i];
+            if (not m_isContiguous)
+                return m_appData[i];
+            MarkDirty(uint32_t(i));
+            return m_contiguousData[i];
+        }
+
+        // read access; doesn't mark the element as changed
+        inline const APP_DATA_T& Get(const int32_t i) {
+            return m_isContiguous ? m_contiguousData[i] : m_appData[i];
         }
 
         void Destroy (void) {
             m_appData.Clear();
+            m_contiguousData.Destroy();
             m_glData.Destroy();
+            m_dirtyRanges.clear();
         }
 
         inline bool HaveAppData(void) {
-            return !m_appData.IsEmpty();
+            return m_isContiguous ? not m_contiguousData.IsEmpty() : not m_appData.IsEmpty();
         }
 
         inline bool HaveGLData(void) {
@@ -112,13 +291,30 @@ class VertexDataBuffer {
         }
 
 		inline bool IsEmpty(void) {
-			return m_appData.IsEmpty();
+			return not HaveAppData();
 		}
 
         ~VertexDataBuffer () {
             Destroy ();
         }
 
+    private:
+        template <typename LIST_T>
+        void CopyAppData(LIST_T& appData) {
+            GL_DATA_T* glData = m_glData.Resize(appData.Length() * m_componentCount);
+            for (auto& v : appData) {
+                memcpy(glData, v.Data(), v.DataSize());
+                glData += v.DataSize() / sizeof(GL_DATA_T);
+            }
+        }
+
+        // copy elements [first, end) of contiguous app data into the existing GL data
+        void CopyAppData(ManagedArray<APP_DATA_T>& appData, uint32_t first, uint32_t end) {
+            GL_DATA_T* glData = m_glData.Data() + size_t(first) * m_componentCount;
+            for (uint32_t i = first; i < end; i++, glData += m_componentCount)
+                memcpy(glData, appData[i].Data(), std::min(size_t(appData[i].DataSize()), m_componentCount * sizeof(GL_DATA_T)));
+        }
+
 };
 
 // =================================================================================================
@@ -130,19 +326,6 @@ class VertexBuffer : public VertexDataBuffer <Vector3f, GLfloat> {
         VertexBuffer(size_t listSegmentSize = 1) 
             : VertexDataBuffer(3, listSegmentSize) 
         { }
-
-        // Create a densely packed numpy array from the vertex data
-        virtual ManagedArray<GLfloat>& Setup(void) {
-            if (HaveAppData()) {
-                m_glData.Resize(m_appData.Length() * 3);
-                GLfloat* glData = m_glData.Data();
-                for (auto& v : m_appData) {
-                    memcpy(glData, v.Data(), v.DataSize());
-                    glData += 3;
-                }
-            }
-            return m_glData;
-        }
 };
 
 // =================================================================================================
@@ -154,18 +337,6 @@ public:
         TexCoordBuffer(size_t listSegmentSize = 1) 
             : VertexDataBuffer(2, listSegmentSize) 
         { }
-
-        // Create a densely packed numpy array from the vertex data
-        virtual ManagedArray<GLfloat>& Setup(void) {
-            if (HaveAppData()) {
-                GLfloat* glData = m_glData.Resize(m_appData.Length() * 2);
-                for (auto& v : m_appData) {
-                    memcpy(glData, v.Data(), v.DataSize());
-                    glData += 2;
-                }
-            }
-            return m_glData;
-        }
 };
 
 // =================================================================================================
@@ -177,45 +348,91 @@ public:
     ColorBuffer(size_t listSegmentSize = 1) 
         : VertexDataBuffer(4, listSegmentSize) 
     { }
-
-    // Create a densely packed numpy array from the vertex data
-    virtual ManagedArray<GLfloat>& Setup(void) {
-        if (HaveAppData()) {
-            float* glData = m_glData.Resize(m_appData.Length() * 4);
-            for (auto& v : m_appData) {
-                memcpy(glData, v.Data(), v.DataSize());
-                glData += 4;
-            }
-        }
-        return m_glData;
-    }
 };
 
 // =================================================================================================
 // Buffer for index data (n-tuples of integer values). 
 // Requires an additional componentCount parameter, as index count depends on the vertex count of the 
 // primitive being rendered (quad: 4, triangle: 3, line: 2, point: 1)
+// If all indices fit into 16 bits, they are additionally kept as 16 bit values, which are uploaded instead
+// (IndexData(), IndexType()). 8 bit indices aren't used, as many GPUs don't support them natively.
 
 class IndexBuffer : public VertexDataBuffer <ManagedArray<GLuint>, GLuint> {
     public:
+    ManagedArray<GLushort>  m_shortIndices;
+    GLenum                  m_indexType;
+
     IndexBuffer(uint32_t componentCount = 1, uint32_t listSegmentSize = 1) 
-        : VertexDataBuffer(componentCount, listSegmentSize) 
+        : VertexDataBuffer(componentCount, listSegmentSize), m_indexType(GL_UNSIGNED_INT)
     { }
 
-    // Create a densely packed numpy array from the vertex data
     virtual ManagedArray<GLuint>& Setup(void) {
+        VertexDataBuffer::Setup();
+        Narrow();
+        return m_glData;
+    }
+
+    // pick the smallest index type for the indices in m_glData. Call after modifying m_glData directly.
+    void Narrow(void) {
+        GLuint maxIndex = 0;
+        for (auto i : m_glData)
+            maxIndex = std::max(maxIndex, i);
+        if (m_glData.IsEmpty() or (maxIndex > 0xFFFF)) {
+            m_indexType = GL_UNSIGNED_INT;
+            m_shortIndices.Clear();
+        }
+        else {
+            m_indexType = GL_UNSIGNED_SHORT;
+            GLushort* shortIndices = m_shortIndices.Resize(m_glData.Length());
+            for (auto i : m_glData)
+                *shortIndices++ = GLushort(i);
+        }
+    }
+
+    inline GLenum IndexType(void) {
+        return m_indexType;
+    }
+
+    inline GLvoid* IndexData(void) {
+        return (m_indexType == GL_UNSIGNED_SHORT) ? (GLvoid*)m_shortIndices.Data() : (GLvoid*)m_glData.Data();
+    }
+
+    inline uint32_t IndexDataSize(void) {
+        return (m_indexType == GL_UNSIGNED_SHORT) ? m_shortIndices.Length() * sizeof(GLushort) : GLDataSize();
+    }
+
+    inline void SetGLData(ManagedArray<GLuint>& glData) {
+        m_glData = glData;
+        Narrow();
+    }
+
+    // replace all indices; app data is rebuilt as tuples of m_componentCount indices if the buffer has app data
+    void SetIndices(const std::vector<GLuint>& indices) {
         if (HaveAppData()) {
-            uint32_t* glData = m_glData.Resize(m_appData.Length() * m_componentCount);
-            for (auto& v : m_appData) {
-                memcpy(glData, v.Data(), v.DataSize());
-                glData += v.Length();
+            m_appData.Clear();
+            m_contiguousData.Clear();
+            for (size_t i = 0; i + m_componentCount <= indices.size(); i += m_componentCount) {
+                ManagedArray<GLuint> tuple;
+                memcpy(tuple.Resize(m_componentCount), indices.data() + i, m_componentCount * sizeof(GLuint));
+                Append(tuple);
             }
+            m_dirtyRanges.clear();
         }
-        return m_glData;
+        else
+            memcpy(m_glData.Resize(indices.size()), indices.data(), indices.size() * sizeof(GLuint));
+        Setup();
+    }
+
+    void Destroy(void) {
+        VertexDataBuffer::Destroy();
+        m_shortIndices.Destroy();
+        m_indexType = GL_UNSIGNED_INT;
     }
 
     IndexBuffer& operator= (IndexBuffer const& other) {
         Copy (other);
+        m_shortIndices = other.m_shortIndices;
+        m_indexType = other.m_indexType;
         return *this;
     }
 
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "glew.h"
+#include "string.hpp"
+#include "list.hpp"
+#include "texture.h"
+#include "texturefile.h"
+#include "shader.h"
+#include "colordata.h"
+
+// =================================================================================================
+// Software virtual texture for images too large to keep on the GPU as a whole.
+// The image comes from its cooked file (incl. mip chain), which is memory mapped, so only the parts actually used are
+// read from disk. Each mip level is split into pages of pageSize x pageSize pixels. Resident pages live in the slots
+// of the physical page texture; slots have a border of one pixel taken from the neighbouring pages, so bilinear
+// filtering doesn't bleed between pages. The page table texture has one texel per page of level 0 and points it to
+// the slot of the finest resident page covering it. The coarsest level consists of a single page which always stays
+// resident, so every texel has a fallback.
+// The pages needed are determined by a feedback pass: the scene is rendered at low resolution with the feedback
+// shader, which writes the page and mip level each fragment wants. ReadFeedback() reads the result back, and
+// Update() streams in missing pages, evicting the least recently used ones, and updates the page table.
+// Needs nothing beyond OpenGL 3.3 (no sparse textures). Page coordinates are written to 8 bit channels, so level 0
+// can have at most 256 pages in each direction. Images whose size is a power of two work best, since pages of
+// coarser levels then exactly cover the pages of finer levels.
+
+class VirtualTexture {
+    public:
+        struct Slot {
+            uint32_t    page;       // page held by the slot; invalidPage if the slot is free
+            uint32_t    lastUsed;   // update in which the page has last been requested
+            bool        isPinned;
+        };
+
+        struct PageStats {
+            int     requestCount = 0;   // distinct pages requested by the last feedback
+            int     uploadCount = 0;    // pages uploaded by the last update
+            int     residentCount = 0;
+        };
+
+        static constexpr uint32_t   invalidPage = 0xFFFFFFFF;
+        static constexpr int        border = 1;
+
+        String                              m_name;
+        std::shared_ptr<TextureFile>        m_source;
+        Texture                             m_pageTable;
+        Texture                             m_physicalPages;
+        int                                 m_width;
+        int                                 m_height;
+        int                                 m_levelCount;   // levels used; the last one fits into a single page
+        int                                 m_pageSize;
+        int                                 m_slotSize;     // page size incl. borders
+        int                                 m_slotsPerRow;
+        std::vector<Slot>                   m_slots;
+        std::unordered_map<uint32_t, int>   m_pageSlots;
+        std::vector<uint32_t>               m_requests;     // pages requested by the last feedback, coarsest first
+        std::vector<uint8_t>                m_pageTableData;
+        std::vector<uint8_t>                m_feedback;
+        uint32_t                            m_frame;
+        PageStats                           m_stats;
+
+        VirtualTexture()
+            : m_width(0), m_height(0), m_levelCount(0), m_pageSize(0), m_slotSize(0), m_slotsPerRow(0), m_frame(0)
+        { }
+
+        ~VirtualTexture() {
+            Destroy();
+        }
+
+        // fileNames holds the image file. If there is no cooked file with a mip chain for it yet, it is cooked first.
+        // slotCount is the number of pages the physical page texture can hold.
+        bool Create(List<String>& fileNames, bool flipVertically = false, int pageSize = 128, int slotCount = 256);
+
+        void Destroy(void);
+
+        // read the feedback pass back from the current read framebuffer and process it
+        void ReadFeedback(int width, int height);
+
+        // feedback holds pixelCount RGBA texels as written by the feedback shader
+        void ProcessFeedback(const uint8_t* feedback, int pixelCount);
+
+        // upload up to maxUploads missing pages and update the page table. Call once per frame after the feedback pass.
+        int Update(int maxUploads = 32);
+
+        // select the virtual texture shader and enable page table and physical pages on texture units firstTmu and firstTmu + 1.
+        // The texture color is multiplied by color.
+        Shader* SetupShader(int firstTmu = 0, const RGBAColor& color = ColorData::White);
+
+        // select the feedback shader. feedbackScale is the ratio of the screen resolution to the feedback resolution.
+        Shader* SetupFeedbackShader(float feedbackScale = 8.0f);
+
+        inline const PageStats& GetStats(void) {
+            return m_stats;
+        }
+
+    private:
+        static inline uint32_t PageKey(int level, int x, int y) {
+            return (uint32_t(level) << 24) | (uint32_t(y) << 12) | uint32_t(x);
+        }
+
+        static inline int PageLevel(uint32_t page) {
+            return int(page >> 24);
+        }
+
+        static inline int PageX(uint32_t page) {
+            return int(page & 0xFFF);
+        }
+
+        static inline int PageY(uint32_t page) {
+            return int((page >> 12) & 0xFFF);
+        }
+
+        inline int LevelWidth(int level) {
+            return std::max(1, m_width >> level);
+        }
+
+        inline int LevelHeight(int level) {
+            return std::max(1, m_height >> level);
+        }
+
+        inline int PageCountX(int level) {
+            return (LevelWidth(level) + m_pageSize - 1) / m_pageSize;
+        }
+
+        inline int PageCountY(int level) {
+            return (LevelHeight(level) + m_pageSize - 1) / m_pageSize;
+        }
+
+        bool OpenSource(List<String>& fileNames, bool flipVertically);
+
+        int AllocateSlot(void);
+
+        void ExtractPage(uint32_t page, uint8_t* dest);
+
+        void UpdatePageTable(void);
+};
+
+// =================================================================================================
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <exception>
+
+#include "singletonbase.hpp"
+
+// =================================================================================================
+// Small worker thread pool for CPU side preparation work (image decoding, pixel conversion etc.)
+// Tasks must never call OpenGL: All GL calls have to happen on the thread owning the GL context,
+// so tasks only prepare data and hand the results back to that thread, e.g. via a CompletionQueue.
+// If the machine only has a single core, tasks are executed immediately by the submitting thread.
+
+class WorkerPool
+    : public BaseSingleton<WorkerPool>
+{
+    public:
+        using Task = std::function<void(void)>;
+
+    private:
+        std::vector<std::thread>    m_workers;
+        std::deque<Task>            m_tasks;
+        std::mutex                  m_lock;
+        std::condition_variable     m_wakeUp;
+        std::condition_variable     m_idle;
+        int                         m_busyCount;
+        bool                        m_isRunning;
+
+    public:
+        WorkerPool()
+            : m_busyCount(0), m_isRunning(false)
+        { }
+
+        ~WorkerPool() {
+            Stop();
+        }
+
+        // workerCount 0: use all cores but one (leaving that one to the GL thread)
+        bool Start(int workerCount = 0);
+
+        void Stop(void);
+
+        void Submit(Task task);
+
+        // wait until all submitted tasks have been executed
+        void Wait(void);
+
+        // Call task(i) for i = 0 .. count - 1 on the workers and the calling thread and return when all calls
+        // have finished. The calling thread works on the items itself while waiting, so this can safely be
+        // called from within a task. If calls of task throw, the first exception is rethrown once all calls have finished.
+        void ParallelFor(int count, std::function<void(int)> task);
+
+        inline int WorkerCount(void) {
+            return int(m_workers.size());
+        }
+
+        inline bool IsRunning(void) {
+            return m_isRunning;
+        }
+
+    private:
+        void Run(void);
+};
+
+#define workerPool WorkerPool::Instance()
+
+// =================================================================================================
+// Thread safe FIFO for handing results from worker threads back to the GL thread in the order
+// in which the workers finished them.
+
+template <typename DATA_T>
+class CompletionQueue {
+    private:
+        std::deque<DATA_T>          m_items;
+        std::mutex                  m_lock;
+        std::condition_variable     m_signal;
+
+    public:
+        // signal while holding the lock: The consumer may destroy the queue as soon as it has popped the last item
+        void Push(DATA_T item) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_items.push_back(std::move(item));
+            m_signal.notify_one();
+        }
+
+        // blocks until an item is available
+        DATA_T Pop(void) {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_signal.wait(lock, [this] { return not m_items.empty(); });
+            DATA_T item = std::move(m_items.front());
+            m_items.pop_front();
+            return item;
+        }
+
+        bool TryPop(DATA_T& item) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_items.empty())
+                return false;
+            item = std::move(m_items.front());
+            m_items.pop_front();
+            return true;
+        }
+};
+
+// =================================================================================================
@@ -89,6 +89,7 @@ bool BaseQuad::CreateVAO(void) {
     if (not (m_vao = new VAO(true)))
         return false;
     m_vao->Init(GL_QUADS);
+    m_vao->SetStreamed(true); // quads update their vertex data each time they are rendered
     return true;
 }
 
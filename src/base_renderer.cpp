@@ -8,6 +8,11 @@
 #include "glew.h"
 //#include "quad.h"
 #include "base_renderer.h"
+#include "textureuploader.h"
+#include "streamingbuffer.h"
+#include "vao.h"
+#include "texturehandler.h"
+#include "texturebindings.h"
 
 // =================================================================================================
 // basic renderer class. Initializes display and OpenGL and sets up projections and view transformation
@@ -153,6 +158,12 @@ void BaseRenderer::DrawScreen (bool bRotate, bool bFlipVertically) {
         m_renderTexture.m_handle = m_screenBuffer->BufferHandle(0);
         m_viewportArea.Render(&m_renderTexture); // bFlipVertically);
     }
+    // stream pending texture uploads while the GPU is busy with this frame
+    textureUploader.Update();
+    textureHandler.Update();
+    textureBindings.Update();
+    streamingBuffer.Update();
+    VAO::UpdateBindStats();
 }
 
 
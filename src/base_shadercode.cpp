@@ -11,6 +11,8 @@ const ShaderSource& OutlineShader();
 const ShaderSource& BoxBlurShader();
 const ShaderSource& FxaaShader();
 const ShaderSource& GaussBlurShader();
+const ShaderSource& VirtualTextureShader();
+const ShaderSource& VirtualTextureFeedbackShader();
 
 // -------------------------------------------------------------------------------------------------
 
@@ -21,7 +23,9 @@ BaseShaderCode::BaseShaderCode() {
         &OutlineShader(),
         &BoxBlurShader(),
         &FxaaShader(),
-        &GaussBlurShader()
+        &GaussBlurShader(),
+        &VirtualTextureShader(),
+        &VirtualTextureFeedbackShader()
     };
     AddShaders(shaderSource);
 }
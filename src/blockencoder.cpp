@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "blockencoder.h"
+#include "workerpool.h"
+
+// SSE2 is part of every x86-64 CPU, so it doesn't need a runtime check
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#   define BLOCK_ENCODER_SSE2 1
+#   include <emmintrin.h>
+#else
+#   define BLOCK_ENCODER_SSE2 0
+#endif
+
+// images with fewer rows of blocks are encoded on the calling thread
+static constexpr int minParallelRows = 16;
+
+// BC1 index of the colors c1, 2/3 c1 + 1/3 c0, 1/3 c1 + 2/3 c0, c0
+static const uint32_t colorIndexMap[4] = { 1, 3, 2, 0 };
+
+// BC3 index of the alpha values a1, 6/7 a1 + 1/7 a0, ..., a0
+static const uint32_t alphaIndexMap[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+// =================================================================================================
+
+// gather a 4x4 block as RGBA, repeating the last row and column at the image edges
+static void FetchBlock(uint8_t* block, const uint8_t* pixels, int width, int height, int componentCount, int bx, int by) {
+    for (int y = 0; y < 4; y++) {
+        const uint8_t* row = pixels + size_t(std::min(by + y, height - 1)) * size_t(width) * size_t(componentCount);
+        for (int x = 0; x < 4; x++, block += 4) {
+            const uint8_t* p = row + std::min(bx + x, width - 1) * componentCount;
+            block[0] = p[0];
+            block[1] = p[1];
+            block[2] = p[2];
+            block[3] = (componentCount == 4) ? p[3] : 255;
+        }
+    }
+}
+
+
+static void BoundingBox(const uint8_t* block, uint8_t* minColor, uint8_t* maxColor) {
+#if BLOCK_ENCODER_SSE2
+    __m128i row0 = _mm_loadu_si128((const __m128i*)block);
+    __m128i row1 = _mm_loadu_si128((const __m128i*)(block + 16));
+    __m128i row2 = _mm_loadu_si128((const __m128i*)(block + 32));
+    __m128i row3 = _mm_loadu_si128((const __m128i*)(block + 48));
+    __m128i minPixels = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+    __m128i maxPixels = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+    // reduce the four pixels left in each register
+    minPixels = _mm_min_epu8(minPixels, _mm_srli_si128(minPixels, 8));
+    minPixels = _mm_min_epu8(minPixels, _mm_srli_si128(minPixels, 4));
+    maxPixels = _mm_max_epu8(maxPixels, _mm_srli_si128(maxPixels, 8));
+    maxPixels = _mm_max_epu8(maxPixels, _mm_srli_si128(maxPixels, 4));
+    int minValue = _mm_cvtsi128_si32(minPixels);
+    int maxValue = _mm_cvtsi128_si32(maxPixels);
+    memcpy(minColor, &minValue, 4);
+    memcpy(maxColor, &maxValue, 4);
+#else
+    memcpy(minColor, block, 4);
+    memcpy(maxColor, block, 4);
+    for (int i = 4; i < 64; i++) {
+        minColor[i & 3] = std::min(minColor[i & 3], block[i]);
+        maxColor[i & 3] = std::max(maxColor[i & 3], block[i]);
+    }
+#endif
+}
+
+
+// Moving the color endpoints inwards by 1/16 of the box lowers the error of the colors in between. Alpha
+// isn't inset, so that fully opaque and fully transparent pixels stay exact.
+static void InsetBoundingBox(uint8_t* minColor, uint8_t* maxColor) {
+    for (int i = 0; i < 3; i++) {
+        int inset = (maxColor[i] - minColor[i]) >> 4;
+        minColor[i] = uint8_t(minColor[i] + inset);
+        maxColor[i] = uint8_t(maxColor[i] - inset);
+    }
+}
+
+
+static inline uint16_t To565(const uint8_t* color) {
+    return uint16_t(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+
+static inline void From565(uint16_t color, int* rgb) {
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+
+// Project the pixels onto the axis c1 -> c0 and quantize the projections to the four colors of the block
+static uint32_t ColorIndices(const uint8_t* block, const int* c0, const int* c1) {
+    int axis[3] = { c0[0] - c1[0], c0[1] - c1[1], c0[2] - c1[2] };
+    int length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float scale = 3.0f / float(length);
+    int steps[16];
+#if BLOCK_ENCODER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i base = _mm_set_epi16(0, short(c1[2]), short(c1[1]), short(c1[0]), 0, short(c1[2]), short(c1[1]), short(c1[0]));
+    const __m128i direction = _mm_set_epi16(0, short(axis[2]), short(axis[1]), short(axis[0]), 0, short(axis[2]), short(axis[1]), short(axis[0]));
+    const __m128 scales = _mm_set1_ps(scale);
+    for (int i = 0; i < 4; i++) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+        // r * dr + g * dg and b * db of pixels 0, 1 (lo) and 2, 3 (hi)
+        __m128 lo = _mm_castsi128_ps(_mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(pixels, zero), base), direction));
+        __m128 hi = _mm_castsi128_ps(_mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(pixels, zero), base), direction));
+        __m128i dots = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+        _mm_storeu_si128((__m128i*)(steps + 4 * i), _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(dots), scales)));
+    }
+#else
+    for (int i = 0; i < 16; i++, block += 4) {
+        int dot = (block[0] - c1[0]) * axis[0] + (block[1] - c1[1]) * axis[1] + (block[2] - c1[2]) * axis[2];
+        steps[i] = int(lrintf(float(dot) * scale));
+    }
+#endif
+    uint32_t indices = 0;
+    for (int i = 15; i >= 0; i--)
+        indices = (indices << 2) | colorIndexMap[std::min(3, std::max(0, steps[i]))];
+    return indices;
+}
+
+
+// The bounding box maximum never has a lower 565 value than its minimum, so color0 >= color1 always selects
+// the four color mode, and if both are equal, all pixels use color0.
+static void EncodeColorBlock(uint8_t* dest, const uint8_t* block, const uint8_t* minColor, const uint8_t* maxColor) {
+    uint16_t color0 = To565(maxColor);
+    uint16_t color1 = To565(minColor);
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int c0[3], c1[3];
+        From565(color0, c0);
+        From565(color1, c1);
+        indices = ColorIndices(block, c0, c1);
+    }
+    dest[0] = uint8_t(color0);
+    dest[1] = uint8_t(color0 >> 8);
+    dest[2] = uint8_t(color1);
+    dest[3] = uint8_t(color1 >> 8);
+    for (int i = 0; i < 4; i++)
+        dest[4 + i] = uint8_t(indices >> (8 * i));
+}
+
+
+// alpha0 > alpha1 selects eight interpolated alpha values
+static void EncodeAlphaBlock(uint8_t* dest, const uint8_t* block, int minAlpha, int maxAlpha) {
+    uint64_t indices = 0;
+    if (maxAlpha > minAlpha) {
+        float scale = 7.0f / float(maxAlpha - minAlpha);
+        for (int i = 15; i >= 0; i--)
+            indices = (indices << 3) | alphaIndexMap[int(float(block[4 * i + 3] - minAlpha) * scale + 0.5f)];
+    }
+    dest[0] = uint8_t(maxAlpha);
+    dest[1] = uint8_t(minAlpha);
+    for (int i = 0; i < 6; i++)
+        dest[2 + i] = uint8_t(indices >> (8 * i));
+}
+
+
+static void EncodeBlockRow(uint8_t* dest, const uint8_t* pixels, int width, int height, int componentCount, int by) {
+    uint8_t block[64];
+    uint8_t minColor[4], maxColor[4];
+    for (int bx = 0; bx < width; bx += 4) {
+        FetchBlock(block, pixels, width, height, componentCount, bx, by);
+        BoundingBox(block, minColor, maxColor);
+        if (componentCount == 4) {
+            EncodeAlphaBlock(dest, block, minColor[3], maxColor[3]);
+            dest += 8;
+        }
+        InsetBoundingBox(minColor, maxColor);
+        EncodeColorBlock(dest, block, minColor, maxColor);
+        dest += 8;
+    }
+}
+
+// =================================================================================================
+
+// BC1 blocks with color0 <= color1 have three colors and transparent black; BC3 color blocks always have four colors
+static void DecodeColorBlock(uint8_t* block, const uint8_t* source, bool isBC1) {
+    uint16_t color0 = uint16_t(source[0] | (source[1] << 8));
+    uint16_t color1 = uint16_t(source[2] | (source[3] << 8));
+    int palette[4][4];
+    From565(color0, palette[0]);
+    From565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (not isBC1 or (color0 > color1)) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = (isBC1 and (color0 <= color1)) ? 0 : 255;
+    uint32_t indices = uint32_t(source[4]) | (uint32_t(source[5]) << 8) | (uint32_t(source[6]) << 16) | (uint32_t(source[7]) << 24);
+    for (int i = 0; i < 16; i++, block += 4, indices >>= 2)
+        for (int c = 0; c < 4; c++)
+            block[c] = uint8_t(palette[indices & 3][c]);
+}
+
+
+static void DecodeAlphaBlock(uint8_t* block, const uint8_t* source) {
+    int alpha[8] = { source[0], source[1] };
+    if (alpha[0] > alpha[1]) {
+        for (int i = 1; i < 7; i++)
+            alpha[i + 1] = ((7 - i) * alpha[0] + i * alpha[1]) / 7;
+    }
+    else {
+        for (int i = 1; i < 5; i++)
+            alpha[i + 1] = ((5 - i) * alpha[0] + i * alpha[1]) / 5;
+        alpha[6] = 0;
+        alpha[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int i = 5; i >= 0; i--)
+        indices = (indices << 8) | source[2 + i];
+    for (int i = 0; i < 16; i++, indices >>= 3)
+        block[4 * i + 3] = uint8_t(alpha[indices & 7]);
+}
+
+// =================================================================================================
+
+void BlockEncoder::Encode(uint8_t* dest, const uint8_t* pixels, int width, int height, int componentCount, bool parallel) {
+    int rowCount = (height + 3) / 4;
+    size_t rowSize = size_t((width + 3) / 4) * BlockSize(componentCount);
+    auto encodeRow = [=](int row) {
+        EncodeBlockRow(dest + size_t(row) * rowSize, pixels, width, height, componentCount, 4 * row);
+        };
+    if (parallel and (rowCount >= minParallelRows))
+        workerPool.ParallelFor(rowCount, encodeRow);
+    else
+        for (int row = 0; row < rowCount; row++)
+            encodeRow(row);
+}
+
+
+void BlockEncoder::Decode(uint8_t* dest, const uint8_t* blocks, int width, int height, int componentCount) {
+    uint8_t block[64];
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            if (componentCount == 4) {
+                DecodeColorBlock(block, blocks + 8, false);
+                DecodeAlphaBlock(block, blocks);
+            }
+            else
+                DecodeColorBlock(block, blocks, true);
+            blocks += BlockSize(componentCount);
+            for (int y = 0; (y < 4) and (by + y < height); y++)
+                for (int x = 0; (x < 4) and (bx + x < width); x++)
+                    memcpy(dest + ((size_t(by + y) * width) + bx + x) * componentCount, block + 4 * (4 * y + x), componentCount);
+        }
+    }
+}
+
+
+void BlockEncoder::Benchmark(const uint8_t* pixels, int width, int height, int componentCount) {
+    std::vector<uint8_t> testImage;
+    if (not pixels) { // smooth gradients with some texture
+        testImage.resize(size_t(width) * size_t(height) * size_t(componentCount));
+        uint8_t* p = testImage.data();
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++, p += componentCount) {
+                p[0] = uint8_t(x * 255 / width);
+                p[1] = uint8_t(y * 255 / height);
+                p[2] = uint8_t(128 + 127 * sinf(float(x) * 0.05f) * cosf(float(y) * 0.05f));
+                if (componentCount == 4)
+                    p[3] = uint8_t((x + y) * 255 / (width + height));
+            }
+        }
+        pixels = testImage.data();
+    }
+    size_t imageSize = size_t(width) * size_t(height) * size_t(componentCount);
+    std::vector<uint8_t> blocks(CompressedSize(width, height, componentCount));
+    std::vector<uint8_t> decoded(imageSize);
+    float encodeTimes[2];
+    for (int i = 0; i < 2; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        Encode(blocks.data(), pixels, width, height, componentCount, i == 1);
+        encodeTimes[i] = std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+    }
+    Decode(decoded.data(), blocks.data(), width, height, componentCount);
+    double error = 0.0;
+    for (size_t i = 0; i < imageSize; i++) {
+        double d = double(pixels[i]) - double(decoded[i]);
+        error += d * d;
+    }
+    double mse = error / double(imageSize);
+    double psnr = (mse > 0.0) ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+    fprintf(stderr, "%s %d x %d: %zu -> %zu bytes (%1.1f:1), encoding serial %1.3f ms, parallel %1.3f ms (%d workers), PSNR %1.2f dB\n",
+            (componentCount == 4) ? "BC3" : "BC1", width, height, imageSize, blocks.size(), double(imageSize) / double(blocks.size()),
+            encodeTimes[0] * 1000.0f, encodeTimes[1] * 1000.0f, workerPool.WorkerCount(), psnr);
+}
+
+// =================================================================================================
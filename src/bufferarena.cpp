@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include "bufferarena.h"
+#include "vao.h"
+
+// =================================================================================================
+// Suballocation of a large GL buffer
+
+bool BufferArena::Create(size_t elementSize, size_t capacity) {
+    Destroy();
+    m_elementSize = elementSize;
+    return Relocate(std::max(capacity, size_t(1)), false);
+}
+
+
+void BufferArena::Destroy(void) {
+    if (m_handle) {
+        glDeleteBuffers(1, &m_handle);
+        m_handle = 0;
+    }
+    m_capacity = 0;
+    m_usedSize = 0;
+    m_allocations.clear();
+    m_unusedIds.clear();
+    m_freeBlocks.clear();
+}
+
+
+int BufferArena::FindFreeBlock(size_t size) {
+    for (int i = 0; i < int(m_freeBlocks.size()); i++)
+        if (m_freeBlocks[i].size >= size)
+            return i;
+    return -1;
+}
+
+
+// insert block at its position and merge it with adjacent free blocks
+void BufferArena::AddFreeBlock(Block block) {
+    auto it = std::lower_bound(m_freeBlocks.begin(), m_freeBlocks.end(), block.offset, [](const Block& b, size_t offset) { return b.offset < offset; });
+    if ((it != m_freeBlocks.end()) and (block.offset + block.size == it->offset)) {
+        block.size += it->size;
+        it = m_freeBlocks.erase(it);
+    }
+    if ((it != m_freeBlocks.begin()) and ((it - 1)->offset + (it - 1)->size == block.offset))
+        (it - 1)->size += block.size;
+    else
+        m_freeBlocks.insert(it, block);
+}
+
+
+bool BufferArena::Relocate(size_t capacity, bool compact) {
+    GLuint handle;
+    glGenBuffers(1, &handle);
+    if (handle == 0)
+        return false;
+    // the copy targets leave the array and element array buffer bindings of VAOs alone
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+    glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(capacity * m_elementSize), nullptr, GL_STATIC_DRAW);
+    size_t oldCapacity = m_capacity;
+    if (m_handle) {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_handle);
+        if (not compact)
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, GLsizeiptr(m_capacity * m_elementSize));
+        else {
+            std::vector<uint32_t> ids;
+            for (uint32_t id = 0; id < uint32_t(m_allocations.size()); id++)
+                if (m_allocations[id].size)
+                    ids.push_back(id);
+            std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) { return m_allocations[a].offset < m_allocations[b].offset; });
+            size_t offset = 0;
+            for (uint32_t id : ids) {
+                Block& a = m_allocations[id];
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(a.offset * m_elementSize), GLintptr(offset * m_elementSize), GLsizeiptr(a.size * m_elementSize));
+                a.offset = offset;
+                offset += a.size;
+            }
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &m_handle);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_handle = handle;
+    m_capacity = capacity;
+    if (compact) {
+        m_freeBlocks.clear();
+        oldCapacity = m_usedSize;
+    }
+    if (capacity > oldCapacity)
+        AddFreeBlock(Block{ oldCapacity, capacity - oldCapacity });
+    return true;
+}
+
+
+uint32_t BufferArena::Allocate(const void* data, size_t count) {
+    if ((count == 0) or not m_handle)
+        return invalidAllocation;
+    int i = FindFreeBlock(count);
+    if (i < 0) {
+        if (not Relocate(std::max(2 * m_capacity, m_capacity + count), false))
+            return invalidAllocation;
+        i = FindFreeBlock(count);
+    }
+    Block& freeBlock = m_freeBlocks[i];
+    Block block{ freeBlock.offset, count };
+    freeBlock.offset += count;
+    freeBlock.size -= count;
+    if (freeBlock.size == 0)
+        m_freeBlocks.erase(m_freeBlocks.begin() + i);
+    uint32_t id;
+    if (m_unusedIds.empty()) {
+        id = uint32_t(m_allocations.size());
+        m_allocations.push_back(block);
+    }
+    else {
+        id = m_unusedIds.back();
+        m_unusedIds.pop_back();
+        m_allocations[id] = block;
+    }
+    m_usedSize += count;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_handle);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(block.offset * m_elementSize), GLsizeiptr(count * m_elementSize), data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return id;
+}
+
+
+void BufferArena::Free(uint32_t id) {
+    if ((id >= m_allocations.size()) or (m_allocations[id].size == 0))
+        return;
+    AddFreeBlock(m_allocations[id]);
+    m_usedSize -= m_allocations[id].size;
+    m_allocations[id].size = 0;
+    m_unusedIds.push_back(id);
+}
+
+
+bool BufferArena::Defragment(void) {
+    // nothing to do if the only free space is at the end of the buffer
+    if (m_freeBlocks.empty() or ((m_freeBlocks.size() == 1) and (m_freeBlocks[0].offset == m_usedSize)))
+        return false;
+    return Relocate(m_capacity, true);
+}
+
+
+float BufferArena::Fragmentation(void) {
+    size_t freeSize = m_capacity - m_usedSize;
+    if (freeSize == 0)
+        return 0.0f;
+    size_t largestBlock = 0;
+    for (auto& b : m_freeBlocks)
+        largestBlock = std::max(largestBlock, b.size);
+    return 1.0f - float(largestBlock) / float(freeSize);
+}
+
+// =================================================================================================
+// Static mesh data of all meshes sharing a vertex layout in one vertex and one index arena
+
+bool MeshArenas::IsSupported(void) {
+    return GLEW_VERSION_3_2 or (GLEW_ARB_draw_elements_base_vertex and GLEW_ARB_copy_buffer);
+}
+
+
+void MeshArenas::Destroy(void) {
+    for (auto& arena : m_arenas) {
+        if (arena->vao) {
+            if (VAO::boundHandle == arena->vao)
+                VAO::BindVertexArray(0);
+            glDeleteVertexArrays(1, &arena->vao);
+        }
+    }
+    m_arenas.clear();
+}
+
+
+int MeshArenas::FindArena(VertexLayout& layout) {
+    for (int i = 0; i < int(m_arenas.size()); i++)
+        if (m_arenas[i]->layout.Matches(layout))
+            return i;
+    std::unique_ptr<Arena> arena = std::make_unique<Arena>();
+    if (not (arena->vertices.Create(size_t(layout.m_stride), initialVertexCapacity) and arena->indices.Create(sizeof(GLuint), initialIndexCapacity)))
+        return -1;
+    arena->layout = layout;
+    m_arenas.push_back(std::move(arena));
+    return int(m_arenas.size()) - 1;
+}
+
+
+MeshAllocation MeshArenas::Allocate(VertexLayout& layout, const void* vertexData, uint32_t vertexCount, const GLuint* indices, uint32_t indexCount, GLenum shape) {
+    MeshAllocation allocation;
+    if (layout.IsEmpty() or not IsSupported())
+        return allocation;
+    int i = FindArena(layout);
+    if (i < 0)
+        return allocation;
+    Arena& arena = *m_arenas[i];
+    allocation.vertices = arena.vertices.Allocate(vertexData, vertexCount);
+    allocation.indices = arena.indices.Allocate(indices, indexCount);
+    if ((allocation.vertices == BufferArena::invalidAllocation) or (allocation.indices == BufferArena::invalidAllocation)) {
+        arena.vertices.Free(allocation.vertices);
+        arena.indices.Free(allocation.indices);
+        fprintf(stderr, "MeshArenas: couldn't allocate %u vertices and %u indices\n", vertexCount, indexCount);
+        return MeshAllocation();
+    }
+    allocation.arena = i;
+    allocation.indexCount = GLsizei(indexCount);
+    allocation.shape = shape;
+    return allocation;
+}
+
+
+void MeshArenas::Free(MeshAllocation& allocation) {
+    if (not allocation.IsValid())
+        return;
+    Arena& arena = *m_arenas[allocation.arena];
+    arena.vertices.Free(allocation.vertices);
+    arena.indices.Free(allocation.indices);
+    allocation = MeshAllocation();
+}
+
+
+void MeshArenas::SetupVAO(Arena& arena) {
+    if (not arena.vao)
+        glGenVertexArrays(1, &arena.vao);
+    VAO::BindVertexArray(arena.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, arena.vertices.Handle());
+    for (auto& a : arena.layout.m_attribs) {
+        glVertexAttribPointer(a.index, a.componentCount, a.componentType, a.isNormalized, arena.layout.m_stride, (const GLvoid*)size_t(a.offset));
+        glEnableVertexAttribArray(a.index);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indices.Handle());
+    arena.vertexHandle = arena.vertices.Handle();
+    arena.indexHandle = arena.indices.Handle();
+}
+
+
+void MeshArenas::Render(const MeshAllocation& allocation) {
+    if (not allocation.IsValid())
+        return;
+    Arena& arena = *m_arenas[allocation.arena];
+    if ((arena.vertexHandle != arena.vertices.Handle()) or (arena.indexHandle != arena.indices.Handle()))
+        SetupVAO(arena);
+    else
+        VAO::BindVertexArray(arena.vao);
+    glDrawElementsBaseVertex(allocation.shape, allocation.indexCount, GL_UNSIGNED_INT, (const GLvoid*)(arena.indices[allocation.indices].offset * sizeof(GLuint)),
+                             GLint(arena.vertices[allocation.vertices].offset));
+}
+
+
+void MeshArenas::Defragment(void) {
+    for (auto& arena : m_arenas) {
+        arena->vertices.Defragment();
+        arena->indices.Defragment();
+    }
+}
+
+
+void MeshArenas::ReportStats(void) {
+    for (int i = 0; i < int(m_arenas.size()); i++) {
+        Arena& arena = *m_arenas[i];
+        fprintf(stderr, "mesh arena %d (%d bytes per vertex): %zu of %zu vertices (%1.0f%% fragmented), %zu of %zu indices (%1.0f%% fragmented)\n",
+                i, int(arena.layout.m_stride), arena.vertices.m_usedSize, arena.vertices.m_capacity, 100.0f * arena.vertices.Fragmentation(),
+                arena.indices.m_usedSize, arena.indices.m_capacity, 100.0f * arena.indices.Fragmentation());
+    }
+}
+
+// =================================================================================================
@@ -1,35 +1,72 @@
 #include "cubemap.h"
+#include "textureuploader.h"
 
 // =================================================================================================
 // Load cubemap textures from file and generate an OpenGL cubemap 
 
 void Cubemap::SetParams(void) {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, m_useMipMaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 }
 
 
+SamplerState Cubemap::GetSamplerState(void) {
+    SamplerState state;
+    state.minFilter = m_useMipMaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+    return state;
+}
+
+
+// Upload texBuf to faceCount consecutive faces. When streaming, the texture data is only copied to a PBO once for all of them.
+void Cubemap::DeployFaces(int firstFace, int faceCount, TextureBuffer* texBuf) {
+    GLenum target = GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + firstFace);
+    if (textureUploader.IsStreaming())
+        textureUploader.Enqueue(this, target, texBuf, faceCount);
+    else {
+        for (int i = 0; i < faceCount; i++)
+            UploadImage(GLenum(target + i), texBuf, texBuf->Data());
+    }
+}
+
+
 void Cubemap::Deploy(int bufferIndex) {
-    if (IsAvailable()) {
+    if (IsAvailable() and RestoreData()) {
+        if (m_buffers.IsEmpty()) // e.g. a cubemap used as FBO buffer
+            return;
+        // all cubemap faces must have the same size. Cubemaps always use immutable storage where available, 
+        // so the storage for all six faces and their mip chains is allocated with a single call.
+        TextureBuffer* texBuf = m_buffers.First();
+        if (HaveImmutableStorage() and not AllocateStorage(texBuf->m_info.width, texBuf->m_info.height, texBuf->m_info.internalFormat))
+            return;
         Bind();
-        SetParams();
-        int i = 0;
+        ApplyParams();
         // put the available textures on the cubemap as far as possible and put the last texture on any remaining cubemap faces
         // Reguar case six textures: One texture for each cubemap face
         // Special case one textures: all cubemap faces bear the same texture
         // Special case two textures: first texture goes to first 5 cubemap faces, 2nd texture goes to 6th cubemap face. Special case for smileys with a uniform skin and a face                    
-        TextureBuffer* texBuf = nullptr;
-        for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
-            texBuf = *it;
-            glTexImage2D(GLenum (GL_TEXTURE_CUBE_MAP_POSITIVE_X + i), 0, texBuf->m_info.internalFormat, texBuf->m_info.width, texBuf->m_info.height, 0, texBuf->m_info.format, GL_UNSIGNED_BYTE, texBuf->m_data);
-            ++i;
-        }
+        // Load() shares one buffer between consecutive faces with the same image, so runs of identical buffers are uploaded together.
+        TextureBuffer* faceBuffers[6];
+        int i = 0;
+        texBuf = nullptr;
+        for (auto it = m_buffers.begin(); (it != m_buffers.end()) and (i < 6); ++it)
+            faceBuffers[i++] = texBuf = *it;
         if (texBuf) {
             for (; i < 6; i++)
-                glTexImage2D(GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i), 0, texBuf->m_info.internalFormat, texBuf->m_info.width, texBuf->m_info.height, 0, texBuf->m_info.format, GL_UNSIGNED_BYTE, texBuf->m_data);
+                faceBuffers[i] = texBuf;
+            int firstFace = 0;
+            for (i = 1; i <= 6; i++) {
+                if ((i == 6) or (faceBuffers[i] != faceBuffers[firstFace])) {
+                    DeployFaces(firstFace, i - firstFace, faceBuffers[firstFace]);
+                    firstFace = i;
+                }
+            }
+            if (not textureUploader.IsStreaming()) {
+                GenerateMipMaps();
+                ApplyResidency();
+            }
         }
         Release ();
     }
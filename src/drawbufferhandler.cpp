@@ -8,6 +8,7 @@
 #include "glew.h"
 //#include "quad.h"
 #include "drawbufferhandler.h"
+#include "texturebindings.h"
 
 // =================================================================================================
 // basic renderer class. Initializes display and OpenGL and sets up projections and view transformation
@@ -63,7 +64,8 @@ void DrawBufferHandler::SetDrawBuffers(FBO* fbo, ManagedArray<GLuint>* drawBuffe
 
 void DrawBufferHandler::RestoreDrawBuffer(void) {
     m_drawBufferStack.Pop(m_drawBufferInfo);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    textureBindings.Flush();
+    textureBindings.Bind(textureBindings.ActiveUnit(), GL_TEXTURE_2D, 0);
     if (m_drawBufferInfo.m_fbo != nullptr)
         m_drawBufferInfo.m_fbo->Reenable();
     else
@@ -2,6 +2,8 @@
 #include "fbo.h"
 #include "base_renderer.h"
 #include "base_shaderhandler.h"
+#include "texturebindings.h"
+#include "samplercache.h"
 
 // =================================================================================================
 
@@ -35,7 +37,7 @@ void FBO::CreateBuffer(int bufferIndex, int& attachmentIndex, BufferInfo::eBuffe
     bi.m_handle = SharedTextureHandle();
     bi.m_handle.Claim();
     bi.m_type = bufferType;
-    glBindTexture(GL_TEXTURE_2D, bi.m_handle);
+    textureBindings.Bind(textureBindings.ActiveUnit(), GL_TEXTURE_2D, bi.m_handle);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -54,7 +56,7 @@ void FBO::CreateBuffer(int bufferIndex, int& attachmentIndex, BufferInfo::eBuffe
             glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_width * m_scale, m_height * m_scale, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
             break;
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
+    textureBindings.Bind(textureBindings.ActiveUnit(), GL_TEXTURE_2D, 0);
     ++m_bufferCount;
 }
 
@@ -141,7 +143,11 @@ bool FBO::Create(int width, int height, int scale, const FBOBufferParams& params
 
 void FBO::Destroy(void) {
     for (int i = 0; i < m_bufferCount; i++) {
+        GLuint handle = m_bufferInfo[i].m_handle;
         m_bufferInfo[i].m_handle.Release();
+        // textures may still share the buffer's handle (e.g. the renderer's render texture)
+        if (handle and not glIsTexture(handle))
+            textureBindings.Forget(handle);
     }
     m_handle.Release();
     //glDeleteFramebuffers(1, &m_handle);
@@ -158,7 +164,8 @@ void FBO::Destroy(void) {
 // glDrawBuffers. The effect of that construction is that you can transparently nest 
 // multiple FBO draw buffers.
 void FBO::SelectDrawBuffer(int bufferIndex, bool reenable) {
-    glBindTexture(GL_TEXTURE_2D, 0);
+    textureBindings.Flush();
+    textureBindings.Bind(textureBindings.ActiveUnit(), GL_TEXTURE_2D, 0);
     m_drawBuffers[0] = m_bufferInfo[bufferIndex].m_attachment;
     if (reenable)
         glDrawBuffers(m_drawBuffers.Length(), m_drawBuffers.Data());
@@ -232,11 +239,11 @@ bool FBO::BindBuffer(int bufferIndex, int tmuIndex) {
     for (int i = 0; i < m_bufferCount; ++i)
         if ((i != bufferIndex) and (m_bufferInfo[i].m_tmuIndex == tmuIndex))
             m_bufferInfo[i].m_tmuIndex = -1;
-    glActiveTexture(GL_TEXTURE0 + tmuIndex);
-    glBindTexture(GL_TEXTURE_2D, m_bufferInfo[bufferIndex].m_handle);
+    textureBindings.Bind(tmuIndex, GL_TEXTURE_2D, m_bufferInfo[bufferIndex].m_handle);
+    if (SamplerCache::IsAvailable()) // a texture's sampler may still be bound to this unit
+        textureBindings.BindSampler(tmuIndex, samplerCache.Get(SamplerState{ GL_NEAREST, GL_NEAREST }));
     baseRenderer.CheckGLError("FBO::BindBuffer");
     m_bufferInfo[bufferIndex].m_tmuIndex = tmuIndex;
-    glActiveTexture(GL_TEXTURE0); // always reset!
     return true;
 }
 
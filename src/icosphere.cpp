@@ -18,7 +18,7 @@ GLuint IcoSphere::AddVertexIndices(Dictionary<VertexKey, GLuint>& indexLookup, G
     if (keyPtr)
         return *keyPtr;
     indexLookup.Insert(key, m_vertexCount);
-    Vector3f v = m_vertices [int(i1)] + m_vertices [int(i2)];
+    Vector3f v = m_vertices.Get(int(i1)) + m_vertices.Get(int(i2));
     v.Normalize();
     v *= 0.5f;
     m_vertices.m_appData.Append(v);
@@ -29,7 +29,7 @@ GLuint IcoSphere::AddVertexIndices(Dictionary<VertexKey, GLuint>& indexLookup, G
 List<Vector3f> IcoSphere::CreateFaceNormals(VertexBuffer& vertices, SegmentedList<std::span<GLuint>>& faces) {
     List<Vector3f> faceNormals;
     for (auto& f : faces)
-        faceNormals.Append(Vector3f::Normal(vertices[f[0]], vertices[f[1]], vertices[f[2]]));
+        faceNormals.Append(Vector3f::Normal(vertices.Get(f[0]), vertices.Get(f[1]), vertices.Get(f[2])));
     return faceNormals;
 }
 
@@ -41,7 +41,10 @@ void TriangleIcoSphere::Create(int quality) {
     m_vertexCount = m_vertices.AppDataLength ();
     Refine(m_indices.m_appData, quality);
     m_faceCount = m_indices.AppDataLength();
+    SetOptimize(true); // subdivision emits the faces level by level, which is bad for the vertex cache
     UpdateVAO();
+    SetOptimize(false);
+    m_vertexCount = m_vertices.AppDataLength();
 }
 
 
@@ -216,7 +219,7 @@ void RectangleIcoSphere::SubDivide(SegmentedList<VertexIndices>& faces) {
         GLuint i2 = AddVertexIndices(indexLookup, f2, f3);
         GLuint i3 = AddVertexIndices(indexLookup, f3, f0);
         GLuint i4 = m_vertexCount++;
-        Vector3f v = m_vertices [int(i0)] + m_vertices [int(i1)] + m_vertices [int(i2)] + m_vertices [int(i3)];
+        Vector3f v = m_vertices.Get(int(i0)) + m_vertices.Get(int(i1)) + m_vertices.Get(int(i2)) + m_vertices.Get(int(i3));
         v.Normalize();
         v *= 0.5f;
         m_vertices.m_appData.Append(v);
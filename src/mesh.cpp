@@ -1,5 +1,14 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
 #include "mesh.h"
 #include "texturehandler.h"
+#include "base_shaderhandler.h"
+#include "meshoptimizer.h"
+#include "workerpool.h"
 
 // =================================================================================================
 
@@ -17,10 +26,34 @@ void Mesh::Init(GLenum shape, int32_t listSegmentSize, Texture* texture, String
     m_texCoords = TexCoordBuffer(listSegmentSize);
     m_vertexColors = ColorBuffer(listSegmentSize);
     m_indices = IndexBuffer(ShapeSize(), listSegmentSize);
+    if (m_isContiguous) {
+        m_isContiguous = false;
+        SetContiguous(true);
+    }
     SetupTexture(texture, textureFolder, textureNames, textureType);
 }
 
 
+void Mesh::SetContiguous(bool isContiguous) {
+    if (m_isContiguous == isContiguous)
+        return;
+    m_isContiguous = isContiguous;
+    m_vertices.SetContiguous(isContiguous);
+    m_normals.SetContiguous(isContiguous);
+    m_texCoords.SetContiguous(isContiguous);
+    m_vertexColors.SetContiguous(isContiguous);
+    m_indices.SetContiguous(isContiguous);
+}
+
+
+void Mesh::Reserve(size_t vertexCount) {
+    m_vertices.Reserve(vertexCount);
+    m_normals.Reserve(vertexCount);
+    m_texCoords.Reserve(vertexCount);
+    m_vertexColors.Reserve(vertexCount);
+}
+
+
 void Mesh::CreateVertexIndices(void) {
     uint32_t l = m_vertices.AppDataLength(); // number of quads
     uint32_t* pi = m_indices.m_glData.Resize((l / 2) * 3); // 6 indices for 4 vertices
@@ -29,35 +62,62 @@ void Mesh::CreateVertexIndices(void) {
         for (uint32_t k = 0; k < 6; k++)
             *pi++ = quadTriangleIndices[k] + j;
     }
+    m_indices.Narrow();
 }
 
 
 void Mesh::UpdateVAO(bool createVertexIndex) {
     if (m_shape != GL_QUADS)
         createVertexIndex = false;
+    bool haveStream[4] = { m_vertices.HaveData(), m_texCoords.HaveData(), m_vertexColors.HaveData(), m_normals.HaveData() };
+    int location = 0;
+    for (int i = 0; i < 4; i++)
+        m_attribLocations[i] = haveStream[i] ? location++ : -1;
+    bool haveIndices = m_indices.HaveData();
+    // the conversions are independent of each other and of OpenGL; for large meshes, they run on the worker pool
+    auto setupBuffer = [&](int i) {
+        if (i == 4) {
+            if (haveIndices)
+                m_indices.Setup();
+        }
+        else if (haveStream[i]) {
+            if (i == 0)
+                m_vertices.Setup();
+            else if (i == 1)
+                m_texCoords.Setup();
+            else if (i == 2)
+                m_vertexColors.Setup();
+            else
+                m_normals.Setup();
+        }
+        };
+    if (std::max(m_vertices.AppDataLength(), m_indices.AppDataLength()) >= parallelSetupThreshold)
+        workerPool.ParallelFor(5, setupBuffer);
+    else {
+        for (int i = 0; i < 5; i++)
+            setupBuffer(i);
+    }
+    if (m_optimize and haveIndices)
+        Optimize(false, true); // the buffers have just been set up
+    if (UpdateSharedBuffers(createVertexIndex))
+        return;
     m_vao.Init(createVertexIndex ? GL_TRIANGLES : m_shape);
     m_vao.Enable();
-    if (m_vertices.HaveData()) {
-        m_vertices.Setup();
+    if (m_interleavedStreams)
+        UpdateInterleavedBuffer(); // creates the first VBO, so rendering takes the vertex count from it
+    else
+        m_layoutStreams = 0;
+    if (haveStream[0] and not (m_layoutStreams & vsVertex))
         UpdateVertexBuffer();
-    }
-    if (m_texCoords.HaveData()) {
-        m_texCoords.Setup();
+    if (haveStream[1] and not (m_layoutStreams & vsTexCoord))
         UpdateTexCoordBuffer();
-    }
-    if (m_vertexColors.HaveData()) {
-        m_vertexColors.Setup();
+    if (haveStream[2] and not (m_layoutStreams & vsColor))
         UpdateColorBuffer();
-    }
-    if (m_normals.HaveData()) {
-        m_normals.Setup();
-        // in the case of an icosphere, the vertices also are the vertex normals
+    // in the case of an icosphere, the vertices also are the vertex normals
+    if (haveStream[3] and not (m_layoutStreams & vsNormal))
         UpdateNormalBuffer();
-    }
-    if (m_indices.HaveData()) {
-        m_indices.Setup();
+    if (haveIndices)
         UpdateIndexBuffer();
-    }
     else if (createVertexIndex) {
         CreateVertexIndices();
         m_vao.m_indexBuffer.SetDynamic(true);
@@ -67,9 +127,441 @@ void Mesh::UpdateVAO(bool createVertexIndex) {
 }
 
 
+static const char* streamNames[4] = { "Vertex", "TexCoord", "Color", "Normal" };
+static const int streamComponentCounts[4] = { 3, 2, 4, 3 };
+
+
+bool Mesh::SetAttribFormat(uint32_t stream, AttribFormats format) {
+    static const uint32_t supportedFormats[4] = {
+        (1 << afFloat) | (1 << afShort),
+        (1 << afFloat) | (1 << afHalfFloat) | (1 << afShort),
+        (1 << afFloat) | (1 << afByte),
+        (1 << afFloat) | (1 << afInt1010102)
+    };
+    for (int i = 0; i < 4; i++) {
+        if (stream == (1u << i)) {
+            if (not (supportedFormats[i] & (1 << format)))
+                return false;
+            m_attribFormats[i] = format;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+const GLfloat* Mesh::StreamData(int i, uint32_t& length) {
+    switch (i) {
+        case 0:
+            length = m_vertices.GLDataLength();
+            return m_vertices.GLData();
+        case 1:
+            length = m_texCoords.GLDataLength();
+            return m_texCoords.GLData();
+        case 2:
+            length = m_vertexColors.GLDataLength();
+            return m_vertexColors.GLData();
+        default:
+            length = m_normals.GLDataLength();
+            return m_normals.GLData();
+    }
+}
+
+
+GLsizei Mesh::AttribFormat(int i, GLenum& componentType, GLint& componentCount) {
+    componentCount = streamComponentCounts[i];
+    switch (m_attribFormats[i]) {
+        case afHalfFloat:
+            componentType = GL_HALF_FLOAT;
+            return componentCount * 2;
+        case afShort:
+            if (i == 0) { // pad positions to 8 bytes; the shader ignores w
+                componentType = GL_SHORT;
+                componentCount = 4;
+            }
+            else
+                componentType = GL_UNSIGNED_SHORT;
+            return componentCount * 2;
+        case afByte:
+            componentType = GL_UNSIGNED_BYTE;
+            return 4;
+        case afInt1010102:
+            componentType = GL_INT_2_10_10_10_REV;
+            componentCount = 4;
+            return 4;
+        default:
+            componentType = GL_FLOAT;
+            return componentCount * 4;
+    }
+}
+
+
+// round to nearest; values beyond the half float range become infinite, denormals become zero
+static uint16_t FloatToHalf(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+    int exponent = int((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (exponent <= 0)
+        return sign;
+    if (exponent >= 31)
+        return sign | 0x7C00;
+    uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) // carries into the exponent as needed
+        ++half;
+    return sign | uint16_t(std::min(half, 0x7C00u));
+}
+
+
+static inline int32_t Quantize(float value, float minValue, float maxValue, float scale) {
+    return int32_t(lroundf(std::clamp(value, minValue, maxValue) * scale));
+}
+
+
+// map the bounding box of the positions to [-1, 1]; the vertex shader reverts this with positionScale and positionBias
+void Mesh::ComputePositionTransform(void) {
+    uint32_t length;
+    const GLfloat* positions = StreamData(0, length);
+    float vMin[3] = { 1e30f, 1e30f, 1e30f }, vMax[3] = { -1e30f, -1e30f, -1e30f };
+    for (uint32_t i = 0; i < length; i++) {
+        vMin[i % 3] = std::min(vMin[i % 3], positions[i]);
+        vMax[i % 3] = std::max(vMax[i % 3], positions[i]);
+    }
+    float scale[3], bias[3];
+    for (int i = 0; i < 3; i++) {
+        bias[i] = (vMin[i] + vMax[i]) * 0.5f;
+        scale[i] = std::max((vMax[i] - vMin[i]) * 0.5f, 1e-6f);
+    }
+    m_positionScale = Vector3f{ scale[0], scale[1], scale[2] };
+    m_positionBias = Vector3f{ bias[0], bias[1], bias[2] };
+}
+
+
+void Mesh::PackStream(int i, uint8_t* dest, size_t stride, uint32_t vertexCount, uint32_t firstVertex) {
+    uint32_t length;
+    int componentCount = streamComponentCounts[i];
+    const GLfloat* src = StreamData(i, length) + size_t(firstVertex) * componentCount;
+    AttribFormats format = m_attribFormats[i];
+    if ((i == 0) and (format == afShort))
+        ComputePositionTransform();
+    const float* scale = m_positionScale.Data();
+    const float* bias = m_positionBias.Data();
+    for (uint32_t v = 0; v < vertexCount; v++, src += componentCount, dest += stride) {
+        switch (format) {
+            case afHalfFloat:
+                for (int c = 0; c < componentCount; c++)
+                    ((uint16_t*)dest)[c] = FloatToHalf(src[c]);
+                break;
+            case afShort:
+                if (i == 0) {
+                    for (int c = 0; c < 3; c++)
+                        ((int16_t*)dest)[c] = int16_t(Quantize((src[c] - bias[c]) / scale[c], -1.0f, 1.0f, 32767.0f));
+                    ((int16_t*)dest)[3] = 0;
+                }
+                else {
+                    for (int c = 0; c < componentCount; c++)
+                        ((uint16_t*)dest)[c] = uint16_t(Quantize(src[c], 0.0f, 1.0f, 65535.0f));
+                }
+                break;
+            case afByte:
+                for (int c = 0; c < 4; c++)
+                    dest[c] = uint8_t(Quantize(src[c], 0.0f, 1.0f, 255.0f));
+                break;
+            case afInt1010102: {
+                uint32_t packed = 0;
+                for (int c = 0; c < 3; c++)
+                    packed |= (uint32_t(Quantize(src[c], -1.0f, 1.0f, 511.0f)) & 0x3FF) << (10 * c);
+                memcpy(dest, &packed, sizeof(packed));
+                break;
+            }
+            default:
+                memcpy(dest, src, componentCount * sizeof(GLfloat));
+        }
+    }
+}
+
+
+std::vector<ElementRange>& Mesh::DirtyRanges(int i) {
+    switch (i) {
+        case 0:
+            return m_vertices.m_dirtyRanges;
+        case 1:
+            return m_texCoords.m_dirtyRanges;
+        case 2:
+            return m_vertexColors.m_dirtyRanges;
+        default:
+            return m_normals.m_dirtyRanges;
+    }
+}
+
+
+// Changes are only tracked in contiguous mode. Without any dirty ranges, the data may have been modified
+// directly, so everything is uploaded. Changed quantized positions may change the quantization as a whole.
+bool Mesh::GetUploadRanges(int i, size_t attribSize, std::vector<BufferRange>& uploadRanges) {
+    if (not m_isContiguous)
+        return false;
+    std::vector<ElementRange> ranges;
+    for (int j = 0; j < 4; j++) {
+        if ((i < 0) ? (m_layoutStreams & (1 << j)) : (i == j)) {
+            std::vector<ElementRange>& dirtyRanges = DirtyRanges(j);
+            if ((j == 0) and (m_attribFormats[0] == afShort) and not dirtyRanges.empty())
+                return false;
+            ranges.insert(ranges.end(), dirtyRanges.begin(), dirtyRanges.end());
+        }
+    }
+    if (ranges.empty())
+        return false;
+    std::sort(ranges.begin(), ranges.end(), [](const ElementRange& a, const ElementRange& b) { return a.first < b.first; });
+    uploadRanges.clear();
+    uint32_t first = ranges[0].first, end = ranges[0].end;
+    for (auto& r : ranges) {
+        if (r.first > end) {
+            uploadRanges.push_back(BufferRange{ first * attribSize, (end - first) * attribSize });
+            first = r.first;
+        }
+        end = std::max(end, r.end);
+    }
+    uploadRanges.push_back(BufferRange{ first * attribSize, (end - first) * attribSize });
+    return true;
+}
+
+
+void Mesh::UpdateStreamBuffer(int i) {
+    if (m_layoutStreams & (1 << i)) {
+        UpdateInterleavedBuffer();
+        return;
+    }
+    uint32_t length;
+    const GLfloat* data = StreamData(i, length);
+    uint32_t vertexCount = length / streamComponentCounts[i];
+    GLenum componentType;
+    GLint componentCount;
+    GLsizei attribSize = AttribFormat(i, componentType, componentCount);
+    std::vector<BufferRange> uploadRanges;
+    bool partialUpload = GetUploadRanges(i, attribSize, uploadRanges);
+    if (m_attribFormats[i] == afFloat) // no conversion needed
+        m_vao.UpdateVertexBuffer(streamNames[i], (void*)data, length * sizeof(GLfloat), GL_FLOAT, componentCount, m_attribLocations[i], partialUpload ? &uploadRanges : nullptr);
+    else {
+        if (partialUpload and (m_packedData[i].Length() == size_t(vertexCount) * attribSize)) {
+            for (auto& r : uploadRanges)
+                PackStream(i, m_packedData[i].Data() + r.offset, attribSize, uint32_t(r.size / attribSize), uint32_t(r.offset / attribSize));
+        }
+        else {
+            partialUpload = false;
+            PackStream(i, m_packedData[i].Resize(size_t(vertexCount) * attribSize), attribSize, vertexCount);
+        }
+        m_vao.UpdateVertexBuffer(streamNames[i], m_packedData[i].Data(), m_packedData[i].DataSize(), componentType, componentCount, m_attribLocations[i],
+                                 partialUpload ? &uploadRanges : nullptr);
+    }
+    DirtyRanges(i).clear();
+}
+
+
+uint32_t Mesh::BuildLayout(uint32_t streams, uint32_t& vertexCount) {
+    uint32_t streamLengths[4];
+    for (int i = 0; i < 4; i++)
+        StreamData(i, streamLengths[i]);
+    vertexCount = streamLengths[0] / 3;
+    m_layout.Clear();
+    uint32_t layoutStreams = 0;
+    for (int i = 0; i < 4; i++) {
+        // streams not matching the vertex count (e.g. shared tex coords) keep their own buffer
+        if ((streams & (1 << i)) and (m_attribLocations[i] >= 0) and (streamLengths[i] == vertexCount * streamComponentCounts[i])) {
+            GLenum componentType;
+            GLint componentCount;
+            AttribFormat(i, componentType, componentCount);
+            m_layout.Add(streamNames[i], m_attribLocations[i], componentCount, componentType, VBO::IsIntegerType(componentType) ? GL_TRUE : GL_FALSE,
+                         GLsizei(VBO::ComponentSize(componentType)));
+            layoutStreams |= 1 << i;
+        }
+    }
+    return layoutStreams;
+}
+
+
+void Mesh::UpdateInterleavedBuffer(void) {
+    VertexLayout previousLayout = m_layout;
+    uint32_t vertexCount;
+    m_layoutStreams = BuildLayout(m_interleavedStreams, vertexCount);
+    if (m_layout.IsEmpty() or (vertexCount == 0))
+        return;
+    size_t stride = size_t(m_layout.m_stride);
+    std::vector<BufferRange> uploadRanges;
+    // a changed layout or vertex count needs a full rebuild
+    bool partialUpload = m_layout.Matches(previousLayout) and (m_interleavedData.Length() == vertexCount * stride)
+                         and GetUploadRanges(-1, stride, uploadRanges);
+    if (not partialUpload)
+        uploadRanges.assign(1, BufferRange{ 0, vertexCount * stride });
+    uint8_t* interleavedData = m_interleavedData.Resize(size_t(vertexCount) * stride);
+    for (auto& r : uploadRanges)
+        for (int i = 0, j = 0; i < 4; i++)
+            if (m_layoutStreams & (1 << i))
+                PackStream(i, interleavedData + r.offset + m_layout.m_attribs[j++].offset, stride, uint32_t(r.size / stride), uint32_t(r.offset / stride));
+    m_vao.UpdateInterleavedBuffer("Interleaved", interleavedData, m_interleavedData.DataSize(), m_layout, partialUpload ? &uploadRanges : nullptr);
+    for (int i = 0; i < 4; i++)
+        if (m_layoutStreams & (1 << i))
+            DirtyRanges(i).clear();
+}
+
+
+// Static indexed meshes whose streams all have one entry per vertex go to the mesh arena for their vertex layout
+bool Mesh::UpdateSharedBuffers(bool createVertexIndex) {
+    meshArenas.Free(m_sharedAllocation);
+    if (not m_isShared or m_vao.m_isDynamic or not MeshArenas::IsSupported())
+        return false;
+    GLenum shape = createVertexIndex ? GL_TRIANGLES : m_shape;
+    if (not m_indices.HaveData()) {
+        if (not createVertexIndex)
+            return false;
+        CreateVertexIndices();
+    }
+    uint32_t streams = 0;
+    for (int i = 0; i < 4; i++)
+        if (m_attribLocations[i] >= 0)
+            streams |= 1 << i;
+    uint32_t vertexCount;
+    m_layoutStreams = BuildLayout(streams, vertexCount);
+    if ((m_layoutStreams != streams) or (vertexCount == 0)) {
+        m_layoutStreams = 0;
+        m_layout.Clear();
+        return false;
+    }
+    size_t stride = size_t(m_layout.m_stride);
+    uint8_t* interleavedData = m_interleavedData.Resize(size_t(vertexCount) * stride);
+    for (int i = 0, j = 0; i < 4; i++)
+        if (streams & (1 << i))
+            PackStream(i, interleavedData + m_layout.m_attribs[j++].offset, stride, vertexCount);
+    m_sharedAllocation = meshArenas.Allocate(m_layout, interleavedData, vertexCount, m_indices.GLData(), m_indices.GLDataLength(), shape);
+    m_interleavedData.Destroy(); // the arena holds the data now
+    for (int i = 0; i < 4; i++)
+        DirtyRanges(i).clear();
+    return m_sharedAllocation.IsValid();
+}
+
+
+size_t Mesh::VertexDataSize(bool packed) {
+    size_t dataSize = 0;
+    for (int i = 0; i < 4; i++) {
+        uint32_t length;
+        StreamData(i, length);
+        uint32_t vertexCount = length / streamComponentCounts[i];
+        if (not packed)
+            dataSize += size_t(vertexCount) * streamComponentCounts[i] * sizeof(GLfloat);
+        else {
+            GLenum componentType;
+            GLint componentCount;
+            GLsizei attribSize = AttribFormat(i, componentType, componentCount);
+            if (m_layoutStreams & (1 << i)) // interleaved attributes are 4 byte aligned
+                attribSize = (attribSize + 3) & ~3;
+            dataSize += size_t(vertexCount) * size_t(attribSize);
+        }
+    }
+    return dataSize;
+}
+
+
+void Mesh::ReportVertexDataSize(void) {
+    size_t floatSize = VertexDataSize(false);
+    size_t packedSize = VertexDataSize(true);
+    fprintf(stderr, "mesh '%s': %d vertices, %zu bytes as floats, %zu bytes packed, %zu bytes (%1.1f%%) saved\n",
+            (const char*)m_name, int(m_vertices.GLDataLength() / 3), floatSize, packedSize, floatSize - packedSize,
+            floatSize ? 100.0f * float(floatSize - packedSize) / float(floatSize) : 0.0f);
+}
+
+
+bool Mesh::Optimize(bool report, bool isSetup) {
+    if ((m_shape != GL_TRIANGLES) or not m_vertices.HaveData() or not m_indices.HaveData())
+        return false;
+    if (not isSetup) {
+        m_vertices.Setup();
+        m_texCoords.Setup();
+        m_vertexColors.Setup();
+        m_normals.Setup();
+        m_indices.Setup();
+    }
+    uint32_t vertexCount = m_vertices.GLDataLength() / 3;
+    const float* streams[4];
+    int componentCounts[4];
+    int streamCount = 0;
+    for (int i = 0; i < 4; i++) {
+        uint32_t length;
+        const GLfloat* data = StreamData(i, length);
+        if (length == 0)
+            continue;
+        if (length != vertexCount * streamComponentCounts[i]) // e.g. shared tex coords
+            return false;
+        streams[streamCount] = data;
+        componentCounts[streamCount++] = streamComponentCounts[i];
+    }
+    std::vector<uint32_t> indices(m_indices.GLData(), m_indices.GLData() + m_indices.GLDataLength());
+    if ((indices.size() % 3) or std::any_of(indices.begin(), indices.end(), [=](uint32_t i) { return i >= vertexCount; }))
+        return false;
+
+    MeshOptimizer::CacheStats statsBefore = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+    std::vector<uint32_t> weldRemap, fetchRemap;
+    uint32_t uniqueCount = MeshOptimizer::Weld(streams, componentCounts, streamCount, vertexCount, weldRemap);
+    for (auto& i : indices)
+        i = weldRemap[i];
+    MeshOptimizer::OptimizeVertexCache(indices, uniqueCount);
+    uint32_t usedCount = MeshOptimizer::OptimizeVertexFetch(indices, uniqueCount, fetchRemap);
+    MeshOptimizer::CacheStats statsAfter = MeshOptimizer::AnalyzeVertexCache(indices, usedCount);
+
+    for (auto& i : weldRemap)
+        i = fetchRemap[i];
+    if (m_vertices.HaveData())
+        m_vertices.Remap(weldRemap, usedCount, true);
+    if (m_texCoords.HaveData())
+        m_texCoords.Remap(weldRemap, usedCount, true);
+    if (m_vertexColors.HaveData())
+        m_vertexColors.Remap(weldRemap, usedCount, true);
+    if (m_normals.HaveData())
+        m_normals.Remap(weldRemap, usedCount, true);
+    m_indices.SetIndices(indices);
+    if (report)
+        fprintf(stderr, "mesh '%s': %u -> %u vertices, ACMR %1.3f -> %1.3f, ATVR %1.3f -> %1.3f\n",
+                (const char*)m_name, vertexCount, usedCount, statsBefore.acmr, statsAfter.acmr, statsBefore.atvr, statsAfter.atvr);
+    return true;
+}
+
+
+void Mesh::BenchmarkUpdateVAO(int vertexCount) {
+    int gridSize = std::max(1, int(sqrtf(float(vertexCount / 4))));
+    float updateTimes[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 3; i++) {
+        Mesh mesh;
+        mesh.Init(GL_QUADS, 1);
+        mesh.SetContiguous(i > 0);
+        mesh.SetInterleaved((i == 2) ? vsAll : 0);
+        mesh.Reserve(size_t(gridSize) * size_t(gridSize) * 4);
+        Vector3f normal{ 0.0f, 0.0f, 1.0f };
+        for (int y = 0; y < gridSize; y++) {
+            for (int x = 0; x < gridSize; x++) {
+                static const int corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+                for (auto& c : corners) {
+                    Vector3f v{ float(x + c[0]), float(y + c[1]), 0.0f };
+                    mesh.AddVertex(v);
+                    mesh.AddNormal(normal);
+                    mesh.m_texCoords.Append(TexCoord{ float(x + c[0]) / float(gridSize), float(y + c[1]) / float(gridSize) });
+                }
+            }
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        mesh.UpdateVAO(true);
+        glFinish();
+        updateTimes[i] = std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+    }
+    fprintf(stderr, "UpdateVAO with %d vertices: segmented %1.3f ms, contiguous %1.3f ms, interleaved %1.3f ms\n",
+            gridSize * gridSize * 4, updateTimes[0] * 1000.0f, updateTimes[1] * 1000.0f, updateTimes[2] * 1000.0f);
+}
+
+
 void Mesh::SetupTexture(Texture* texture, String textureFolder, List<String> textureNames, GLenum textureType) {
-    if (not textureNames.IsEmpty())
-        m_textures += textureHandler.CreateByType (textureFolder, textureNames, textureType);
+    if (not textureNames.IsEmpty()) {
+        TextureList textures = textureHandler.CreateByType (textureFolder, textureNames, textureType);
+        m_textures += textures;
+        m_handlerTextures += textures;
+    }
     else if (texture != nullptr)
         m_textures.Append(texture);
 }
@@ -112,14 +604,28 @@ void Mesh::DisableTexture(void) {
 
 
 void Mesh::Render(Shader* shader, Texture* texture) {
-    if (m_vao.IsValid()) {
+    if (m_sharedAllocation.IsValid() or m_vao.IsValid()) {
 #if 0
         SetTexture();
         SetColor();
         SetOutlineColor();
 		SetMaxDistance(maxDistance);
 #endif
-        m_vao.Render(shader, texture);
+        // quantized positions need the shader to restore them
+        Shader* activeShader = (m_attribFormats[0] == afShort) ? baseShaderHandler.m_activeShader : nullptr;
+        if (activeShader)
+            activeShader->SetPositionTransform(m_positionScale, m_positionBias);
+        if (not m_sharedAllocation.IsValid())
+            m_vao.Render(shader, texture);
+        else {
+            if (texture and baseShaderHandler.ShaderIsActive())
+                texture->Enable();
+            meshArenas.Render(m_sharedAllocation);
+            if (texture)
+                texture->Disable();
+        }
+        if (activeShader)
+            activeShader->SetPositionTransform(Vector3f{ 1.0f, 1.0f, 1.0f }, Vector3f{ 0.0f, 0.0f, 0.0f });
     }
 }
 
@@ -130,7 +636,19 @@ void Mesh::Destroy (void) {
     m_texCoords.Destroy ();
     m_vertexColors.Destroy ();
     m_indices.Destroy ();
+    m_interleavedData.Destroy ();
+    for (auto& packedData : m_packedData)
+        packedData.Destroy ();
+    m_layout.Clear ();
+    m_layoutStreams = 0;
     m_textures.Clear ();
+    if (TextureHandler::isAvailable) {
+        for (auto t : m_handlerTextures)
+            textureHandler.Release(t);
+    }
+    m_handlerTextures.Clear ();
+    if (MeshArenas::isAvailable and m_sharedAllocation.IsValid())
+        meshArenas.Free(m_sharedAllocation);
     m_vao.Destroy ();
 }
 
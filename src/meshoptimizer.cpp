@@ -0,0 +1,154 @@
+#include <string.h>
+#include <algorithm>
+
+#include "meshoptimizer.h"
+
+// =================================================================================================
+// Vertex cache and vertex fetch optimization for indexed triangle meshes
+
+static inline uint64_t HashVertex(const float* const* streams, const int* componentCounts, int streamCount, uint32_t v) {
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    for (int j = 0; j < streamCount; j++) {
+        const uint8_t* p = (const uint8_t*)(streams[j] + size_t(v) * componentCounts[j]);
+        for (size_t i = 0; i < componentCounts[j] * sizeof(float); i++)
+            hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+
+static inline bool VerticesMatch(const float* const* streams, const int* componentCounts, int streamCount, uint32_t a, uint32_t b) {
+    for (int j = 0; j < streamCount; j++)
+        if (memcmp(streams[j] + size_t(a) * componentCounts[j], streams[j] + size_t(b) * componentCounts[j], componentCounts[j] * sizeof(float)))
+            return false;
+    return true;
+}
+
+
+// open addressing hash table of the unique vertices found so far
+uint32_t MeshOptimizer::Weld(const float* const* streams, const int* componentCounts, int streamCount, uint32_t vertexCount, std::vector<uint32_t>& remap) {
+    size_t tableSize = 1;
+    while (tableSize < 2 * size_t(vertexCount))
+        tableSize *= 2;
+    std::vector<uint32_t> table(tableSize, unusedVertex);
+    remap.resize(vertexCount);
+    uint32_t uniqueCount = 0;
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        size_t slot = size_t(HashVertex(streams, componentCounts, streamCount, v)) & (tableSize - 1);
+        while ((table[slot] != unusedVertex) and not VerticesMatch(streams, componentCounts, streamCount, table[slot], v))
+            slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == unusedVertex) {
+            table[slot] = v;
+            remap[v] = uniqueCount++;
+        }
+        else
+            remap[v] = remap[table[slot]];
+    }
+    return uniqueCount;
+}
+
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, int cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+    // triangles adjacent to each vertex
+    std::vector<uint32_t> liveCounts(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        ++liveCounts[indices[i]];
+    std::vector<uint32_t> adjacencyOffsets(size_t(vertexCount) + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCounts[v];
+    std::vector<uint32_t> adjacency(adjacencyOffsets[vertexCount]);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[3 * t + k]]++] = uint32_t(t);
+
+    std::vector<uint32_t> timeStamps(vertexCount, 0);
+    std::vector<bool> isEmitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    uint32_t time = uint32_t(cacheSize) + 1;
+    uint32_t cursor = 0;
+    int64_t fanVertex = 0;
+    while (fanVertex >= 0) {
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fanVertex]; a < adjacencyOffsets[fanVertex + 1]; a++) {
+            uint32_t t = adjacency[a];
+            if (isEmitted[t])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[3 * t + k];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveCounts[v];
+                if (time - timeStamps[v] > uint32_t(cacheSize))
+                    timeStamps[v] = time++;
+            }
+            isEmitted[t] = true;
+        }
+        // prefer the candidate that entered the cache earliest and will still be in it after fanning around it
+        fanVertex = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveCounts[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (int64_t(time) - int64_t(timeStamps[v]) + 2 * int64_t(liveCounts[v]) <= cacheSize)
+                priority = int64_t(time) - int64_t(timeStamps[v]);
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fanVertex = v;
+            }
+        }
+        if (fanVertex < 0) { // dead end: take a recently used vertex, or else the next one with triangles left
+            while (not deadEnds.empty() and (fanVertex < 0)) {
+                uint32_t v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveCounts[v] > 0)
+                    fanVertex = v;
+            }
+            for (; (fanVertex < 0) and (cursor < vertexCount); cursor++)
+                if (liveCounts[cursor] > 0)
+                    fanVertex = cursor;
+        }
+    }
+    indices.swap(output);
+}
+
+
+uint32_t MeshOptimizer::OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap) {
+    remap.assign(vertexCount, unusedVertex);
+    uint32_t usedCount = 0;
+    for (auto& i : indices) {
+        if (remap[i] == unusedVertex)
+            remap[i] = usedCount++;
+        i = remap[i];
+    }
+    return usedCount;
+}
+
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, int cacheSize) {
+    std::vector<uint32_t> cacheTimes(vertexCount, 0); // FIFO: a vertex is cached if it has been inserted less than cacheSize misses ago
+    std::vector<bool> isUsed(vertexCount, false);
+    uint32_t missCount = 0;
+    uint32_t usedCount = 0;
+    for (uint32_t i : indices) {
+        if (not isUsed[i]) {
+            isUsed[i] = true;
+            ++usedCount;
+        }
+        else if (missCount - cacheTimes[i] < uint32_t(cacheSize))
+            continue;
+        cacheTimes[i] = ++missCount;
+    }
+    size_t triangleCount = indices.size() / 3;
+    return CacheStats{ triangleCount ? float(missCount) / float(triangleCount) : 0.0f, usedCount ? float(missCount) / float(usedCount) : 0.0f };
+}
+
+// =================================================================================================
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "SDL.h"
+#include "pixelkernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#   define PIXEL_KERNELS_X86 1
+#   include <immintrin.h>
+#   if defined(__GNUC__) || defined(__clang__)
+#       define TARGET_SSE2 __attribute__((target("sse2")))
+#       define TARGET_SSSE3 __attribute__((target("ssse3")))
+#       define TARGET_AVX2 __attribute__((target("avx2")))
+#   else
+#       define TARGET_SSE2
+#       define TARGET_SSSE3
+#       define TARGET_AVX2
+#   endif
+#else
+#   define PIXEL_KERNELS_X86 0
+#endif
+
+// =================================================================================================
+// Row kernels. Each SIMD kernel handles as many pixels as it can and returns the number of pixels processed;
+// the scalar kernels finish the row.
+
+static inline uint8_t Premultiply(uint8_t c, uint8_t a) {
+    uint32_t t = uint32_t(c) * uint32_t(a) + 128;
+    return uint8_t((t + (t >> 8)) >> 8); // exact c * a / 255, rounded
+}
+
+
+static int PremultiplyRowScalar(uint8_t* data, int x, int width) {
+    for (uint8_t* p = data + 4 * x; x < width; x++, p += 4) {
+        p[0] = Premultiply(p[0], p[3]);
+        p[1] = Premultiply(p[1], p[3]);
+        p[2] = Premultiply(p[2], p[3]);
+    }
+    return width;
+}
+
+
+static int ExpandRGBRowScalar(uint8_t* dest, const uint8_t* source, int x, int width) {
+    for (dest += 4 * x, source += 3 * x; x < width; x++, dest += 4, source += 3) {
+        dest[0] = source[0];
+        dest[1] = source[1];
+        dest[2] = source[2];
+        dest[3] = 255;
+    }
+    return width;
+}
+
+
+// a gather is not faster than scalar table lookups, so there are no SIMD versions of this
+static void ExpandPaletteRow(uint8_t* dest, const uint8_t* source, const uint32_t* palette, int width) {
+    for (int x = 0; x < width; x++, dest += 4)
+        memcpy(dest, palette + source[x], 4);
+}
+
+
+static int DownsampleRowScalar(uint8_t* dest, const uint8_t* row0, const uint8_t* row1, int x, int width, int componentCount) {
+    int destWidth = std::max(1, width / 2);
+    for (dest += x * componentCount; x < destWidth; x++) {
+        int x0 = std::min(2 * x, width - 1) * componentCount;
+        int x1 = std::min(2 * x + 1, width - 1) * componentCount;
+        for (int c = 0; c < componentCount; c++)
+            *dest++ = uint8_t((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+    }
+    return destWidth;
+}
+
+
+// sRGB <-> linear light. Linear values have 16 bits; the way back uses their upper 12 bits. Every 8 bit value has
+// a bucket of its own in the 12 bit table, so the table is patched to return each value exactly when it is converted
+// back, which keeps uniform areas unchanged.
+struct GammaTables {
+    uint16_t    toLinear[256];
+    uint8_t     toSRGB[4096];
+
+    GammaTables() {
+        for (int i = 0; i < 256; i++) {
+            float c = float(i) / 255.0f;
+            c = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+            toLinear[i] = uint16_t(lrintf(c * 65535.0f));
+        }
+        for (int i = 0; i < 4096; i++) {
+            float l = (float(i) + 0.5f) / 4096.0f;
+            l = (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+            toSRGB[i] = uint8_t(lrintf(std::min(1.0f, l) * 255.0f));
+        }
+        for (int i = 0; i < 256; i++)
+            toSRGB[toLinear[i] >> 4] = uint8_t(i);
+    }
+};
+
+
+static const GammaTables& Gamma(void) {
+    static GammaTables tables;
+    return tables;
+}
+
+
+// table lookups don't vectorize (see ExpandPaletteRow), so there is only a scalar version of this
+static void DownsampleRowGamma(uint8_t* dest, const uint8_t* row0, const uint8_t* row1, int width, int componentCount) {
+    const GammaTables& gamma = Gamma();
+    int destWidth = std::max(1, width / 2);
+    for (int x = 0; x < destWidth; x++, dest += componentCount) {
+        int x0 = std::min(2 * x, width - 1) * componentCount;
+        int x1 = std::min(2 * x + 1, width - 1) * componentCount;
+        for (int c = 0; c < 3; c++) {
+            int sum = gamma.toLinear[row0[x0 + c]] + gamma.toLinear[row0[x1 + c]] + gamma.toLinear[row1[x0 + c]] + gamma.toLinear[row1[x1 + c]];
+            dest[c] = gamma.toSRGB[((sum + 2) >> 2) >> 4];
+        }
+        if (componentCount == 4)
+            dest[3] = uint8_t((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) >> 2);
+    }
+}
+
+#if PIXEL_KERNELS_X86
+
+// 16 bit lanes: (x + 128 + ((x + 128) >> 8)) >> 8 == x / 255 rounded for x <= 255 * 255
+TARGET_SSE2
+static int PremultiplyRowSSE2(uint8_t* data, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaLanes = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0); // multiply alpha by 255, i.e. keep it
+    const __m128i round = _mm_set1_epi16(128);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(data + 4 * x));
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+        __m128i alphaLo = _mm_max_epi16(_mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF), alphaLanes);
+        __m128i alphaHi = _mm_max_epi16(_mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF), alphaLanes);
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, alphaLo), round);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, alphaHi), round);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i*)(data + 4 * x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+
+TARGET_AVX2
+static int PremultiplyRowAVX2(uint8_t* data, int width) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaLanes = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+    const __m256i round = _mm256_set1_epi16(128);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(data + 4 * x));
+        __m256i lo = _mm256_unpacklo_epi8(pixels, zero);
+        __m256i hi = _mm256_unpackhi_epi8(pixels, zero);
+        __m256i alphaLo = _mm256_max_epi16(_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xFF), 0xFF), alphaLanes);
+        __m256i alphaHi = _mm256_max_epi16(_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xFF), 0xFF), alphaLanes);
+        lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, alphaLo), round);
+        hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, alphaHi), round);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        _mm256_storeu_si256((__m256i*)(data + 4 * x), _mm256_packus_epi16(lo, hi)); // unpack and pack both work per 128 bit lane
+    }
+    return x;
+}
+
+
+// four pixels per iteration. Reads 16 source bytes, so it stops 6 pixels before the end of the row.
+TARGET_SSSE3
+static int ExpandRGBRowSSSE3(uint8_t* dest, const uint8_t* source, int width) {
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+    int x = 0;
+    for (; x + 6 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(source + 3 * x));
+        _mm_storeu_si128((__m128i*)(dest + 4 * x), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    return x;
+}
+
+
+// eight pixels per iteration: source bytes 0..11 go to the lower, bytes 12..23 to the upper 128 bit lane
+TARGET_AVX2
+static int ExpandRGBRowAVX2(uint8_t* dest, const uint8_t* source, int width) {
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                             0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32(int(0xFF000000));
+    int x = 0;
+    for (; x + 11 <= width; x += 8) {
+        __m256i pixels = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(source + 3 * x)), permute);
+        _mm256_storeu_si256((__m256i*)(dest + 4 * x), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    return x;
+}
+
+
+// Two RGBA destination pixels from four pixels of each source row: vertical sums of pixels 0, 1 (lo) and 2, 3 (hi);
+// adding the upper 64 bits to the lower ones adds the horizontal neighbours.
+TARGET_SSE2
+static inline __m128i DownsamplePixelsSSE2(const uint8_t* p0, const uint8_t* p1) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i*)p0);
+    __m128i b = _mm_loadu_si128((const __m128i*)p1);
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_set1_epi16(2)), 2);
+}
+
+
+// four RGBA destination pixels per iteration
+TARGET_SSE2
+static int DownsampleRowSSE2(uint8_t* dest, const uint8_t* row0, const uint8_t* row1, int width) {
+    int destWidth = width / 2;
+    int x = 0;
+    for (; x + 4 <= destWidth; x += 4) {
+        const uint8_t* p0 = row0 + 8 * x;
+        const uint8_t* p1 = row1 + 8 * x;
+        _mm_storeu_si128((__m128i*)(dest + 4 * x), _mm_packus_epi16(DownsamplePixelsSSE2(p0, p1), DownsamplePixelsSSE2(p0 + 16, p1 + 16)));
+    }
+    return x;
+}
+
+#endif
+
+// =================================================================================================
+
+static PixelKernels::InstructionSet SupportedInstructionSet(void) {
+#if PIXEL_KERNELS_X86
+    if (SDL_HasAVX2())
+        return PixelKernels::InstructionSet::AVX2;
+    if (SDL_HasSSSE3())
+        return PixelKernels::InstructionSet::SSSE3;
+    if (SDL_HasSSE2())
+        return PixelKernels::InstructionSet::SSE2;
+#endif
+    return PixelKernels::InstructionSet::Scalar;
+}
+
+
+PixelKernels::InstructionSet PixelKernels::instructionSet = SupportedInstructionSet();
+
+
+void PixelKernels::SetInstructionSet(InstructionSet set) {
+    InstructionSet supportedSet = SupportedInstructionSet();
+    instructionSet = (set < supportedSet) ? set : supportedSet;
+}
+
+
+const char* PixelKernels::InstructionSetName(InstructionSet set) {
+    switch (set) {
+        case InstructionSet::AVX2:
+            return "AVX2";
+        case InstructionSet::SSSE3:
+            return "SSSE3";
+        case InstructionSet::SSE2:
+            return "SSE2";
+        default:
+            return "scalar";
+    }
+}
+
+
+static inline const uint8_t* SourceRow(const uint8_t* source, int y, int height, int pitch, bool flipVertically) {
+    return source + size_t(flipVertically ? height - 1 - y : y) * size_t(pitch);
+}
+
+
+void PixelKernels::PremultiplyAlpha(uint8_t* data, int pixelCount) {
+    int x = 0;
+#if PIXEL_KERNELS_X86
+    if (instructionSet == InstructionSet::AVX2)
+        x = PremultiplyRowAVX2(data, pixelCount);
+    else if (instructionSet != InstructionSet::Scalar)
+        x = PremultiplyRowSSE2(data, pixelCount);
+#endif
+    PremultiplyRowScalar(data, x, pixelCount);
+}
+
+
+void PixelKernels::Copy(uint8_t* dest, const uint8_t* source, int width, int height, int pitch, int componentCount, bool flipVertically, bool premultiplyAlpha) {
+    size_t rowSize = size_t(width) * size_t(componentCount);
+    premultiplyAlpha = premultiplyAlpha and (componentCount == 4);
+    for (int y = 0; y < height; y++, dest += rowSize) {
+        memcpy(dest, SourceRow(source, y, height, pitch, flipVertically), rowSize);
+        if (premultiplyAlpha)
+            PremultiplyAlpha(dest, width);
+    }
+}
+
+
+void PixelKernels::ExpandRGB(uint8_t* dest, const uint8_t* source, int width, int height, int pitch, bool flipVertically) {
+    for (int y = 0; y < height; y++, dest += 4 * size_t(width)) {
+        const uint8_t* row = SourceRow(source, y, height, pitch, flipVertically);
+        int x = 0;
+#if PIXEL_KERNELS_X86
+        if (instructionSet == InstructionSet::AVX2)
+            x = ExpandRGBRowAVX2(dest, row, width);
+        else if (instructionSet == InstructionSet::SSSE3)
+            x = ExpandRGBRowSSSE3(dest, row, width);
+#endif
+        ExpandRGBRowScalar(dest, row, x, width);
+    }
+}
+
+
+void PixelKernels::ExpandPalette(uint8_t* dest, const uint8_t* source, const uint32_t* palette, int width, int height, int pitch, bool flipVertically, bool premultiplyAlpha) {
+    for (int y = 0; y < height; y++, dest += 4 * size_t(width)) {
+        ExpandPaletteRow(dest, SourceRow(source, y, height, pitch, flipVertically), palette, width);
+        if (premultiplyAlpha)
+            PremultiplyAlpha(dest, width);
+    }
+}
+
+
+void PixelKernels::DownsampleRow(uint8_t* dest, const uint8_t* row0, const uint8_t* row1, int width, int componentCount, bool gammaCorrect) {
+    if (gammaCorrect) {
+        DownsampleRowGamma(dest, row0, row1, width, componentCount);
+        return;
+    }
+    int x = 0;
+#if PIXEL_KERNELS_X86
+    if ((componentCount == 4) and (instructionSet != InstructionSet::Scalar))
+        x = DownsampleRowSSE2(dest, row0, row1, width);
+#endif
+    DownsampleRowScalar(dest, row0, row1, x, width, componentCount);
+}
+
+
+void PixelKernels::Benchmark(int width, int height, int rounds) {
+    SDL_Surface* source = SDL_CreateRGBSurfaceWithFormat(0, width, height, 24, SDL_PIXELFORMAT_RGB24);
+    if (not source) {
+        fprintf(stderr, "PixelKernels::Benchmark: %s\n", SDL_GetError());
+        return;
+    }
+    uint8_t* pixels = (uint8_t*)source->pixels;
+    for (int i = 0; i < source->pitch * height; i++)
+        pixels[i] = uint8_t(i * 7);
+    std::vector<uint8_t> dest(size_t(width) * size_t(height) * 4);
+
+    // previous TextureBuffer::Create path: SDL conversion to a new surface, then a row by row flip into the texture buffer
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        SDL_Surface* converted = SDL_ConvertSurfaceFormat(source, SDL_PIXELFORMAT_RGBA32, 0);
+        if (not converted)
+            break;
+        Copy(dest.data(), (const uint8_t*)converted->pixels, width, height, converted->pitch, 4, true);
+        SDL_FreeSurface(converted);
+    }
+    float sdlTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count() / float(rounds);
+    fprintf(stderr, "RGB -> RGBA + flip, %d x %d: SDL %1.3f ms", width, height, sdlTime * 1000.0f);
+
+    InstructionSet supportedSet = instructionSet;
+    for (int set = int(InstructionSet::Scalar); set <= int(supportedSet); set++) {
+        instructionSet = InstructionSet(set);
+        t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+            ExpandRGB(dest.data(), pixels, width, height, source->pitch, true);
+        float kernelTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count() / float(rounds);
+        fprintf(stderr, ", %s %1.3f ms", InstructionSetName(instructionSet), kernelTime * 1000.0f);
+    }
+    fprintf(stderr, "\n");
+    instructionSet = supportedSet;
+    SDL_FreeSurface(source);
+}
+
+// =================================================================================================
@@ -0,0 +1,35 @@
+#include "samplercache.h"
+#include "texturebindings.h"
+
+// =================================================================================================
+// Deduplicating cache of GL sampler objects
+
+GLuint SamplerCache::Get(const SamplerState& state) {
+    for (auto& s : m_samplers)
+        if (s.state == state)
+            return s.handle;
+    if (not IsAvailable())
+        return 0;
+    GLuint handle;
+    glGenSamplers(1, &handle);
+    if (handle == 0)
+        return 0;
+    glSamplerParameteri(handle, GL_TEXTURE_MIN_FILTER, state.minFilter);
+    glSamplerParameteri(handle, GL_TEXTURE_MAG_FILTER, state.magFilter);
+    glSamplerParameteri(handle, GL_TEXTURE_WRAP_S, state.wrapS);
+    glSamplerParameteri(handle, GL_TEXTURE_WRAP_T, state.wrapT);
+    glSamplerParameteri(handle, GL_TEXTURE_WRAP_R, state.wrapR);
+    glSamplerParameteri(handle, GL_TEXTURE_COMPARE_MODE, state.compareMode);
+    m_samplers.Append({ state, handle });
+    return handle;
+}
+
+
+void SamplerCache::Destroy(void) {
+    for (auto& s : m_samplers)
+        glDeleteSamplers(1, &s.handle);
+    m_samplers.Clear();
+    textureBindings.ForgetSamplers();
+}
+
+// =================================================================================================
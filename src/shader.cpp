@@ -96,6 +96,7 @@ void Shader::UpdateMatrices(void) {
         SetMatrix4f("mBaseModelView", m_locations.Current(), baseRenderer.ModelView().AsArray(), false);
 #endif
     }
+    SetPositionTransform(Vector3f{ 1.0f, 1.0f, 1.0f }, Vector3f{ 0.0f, 0.0f, 0.0f });
 #if 0
     baseRenderer.CheckModelView();
     baseRenderer.CheckProjection();
@@ -106,6 +107,13 @@ void Shader::UpdateMatrices(void) {
 
 
 
+void Shader::SetPositionTransform(const Vector3f& scale, const Vector3f& bias) {
+    m_positionLocations.Start();
+    SetVector3f("positionScale", m_positionLocations.Current(), scale);
+    SetVector3f("positionBias", m_positionLocations.Current(), bias);
+}
+
+
 GLint Shader::SetMatrix4f(const char* name, GLint& location, const float* data, bool transpose) {
 #if PASSTHROUGH_MODE
     GetLocation(name, location);
@@ -15,10 +15,13 @@ const String& StandardVS() {
             layout(location = 1) in vec2 texCoord;
             uniform mat4 mModelView;
             uniform mat4 mProjection;
+            uniform vec3 positionScale; // restores quantized positions
+            uniform vec3 positionBias;
             out vec3 fragPos;
             out vec2 fragTexCoord;
             void main() {
-                vec4 viewPos = mModelView * vec4 (position, 1.0);
+                vec3 vertexPos = position * positionScale + positionBias;
+                vec4 viewPos = mModelView * vec4 (vertexPos, 1.0);
                 gl_Position = mProjection * viewPos;
                 fragTexCoord = texCoord;
                 fragPos = viewPos.xyz;
@@ -38,12 +41,15 @@ const String& OffsetVS() {
             layout(location = 1) in vec2 texCoord;
             uniform mat4 mModelView;
             uniform mat4 mProjection;
+            uniform vec3 positionScale; // restores quantized positions
+            uniform vec3 positionBias;
             uniform float offset;
             out vec3 fragPos;
             out vec2 fragTexCoord;
             void main() {
-                vec4 viewPos = mModelView * vec4 (position, 1.0);
-                gl_Position = mProjection * vec4(viewPos.x + offset, position.y + offset, position.z, 1.0);
+                vec3 vertexPos = position * positionScale + positionBias;
+                vec4 viewPos = mModelView * vec4 (vertexPos, 1.0);
+                gl_Position = mProjection * vec4(viewPos.x + offset, vertexPos.y + offset, vertexPos.z, 1.0);
                 fragTexCoord = texCoord;
                 fragPos = viewPos.xyz;
                 }
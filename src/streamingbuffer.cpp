@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "streamingbuffer.h"
+
+// =================================================================================================
+// Ring buffer for streaming vertex data that is rewritten every frame
+
+bool StreamingBuffer::Create(size_t regionSize, int regionCount) {
+    Destroy();
+    m_isAvailable = GLEW_VERSION_3_0 or GLEW_ARB_map_buffer_range;
+    if (not m_isAvailable or (regionCount < 2))
+        return m_isAvailable = false;
+    m_regionSize = (regionSize + alignment - 1) & ~(alignment - 1);
+    size_t bufferSize = m_regionSize * size_t(regionCount);
+    m_isPersistent = (GLEW_VERSION_4_4 or GLEW_ARB_buffer_storage) and (GLEW_VERSION_3_2 or GLEW_ARB_sync);
+    for (int i = 0; i < 2; i++) {
+        glGenBuffers(1, &m_handle);
+        if (m_handle == 0)
+            return m_isAvailable = false;
+        glBindBuffer(GL_ARRAY_BUFFER, m_handle);
+        if (not m_isPersistent) {
+            glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+            break;
+        }
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, bufferSize, nullptr, flags);
+        if ((m_data = reinterpret_cast<uint8_t*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bufferSize, flags))))
+            break;
+        // the storage of the buffer is immutable now, so orphaning needs a new one
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &m_handle);
+        m_handle = 0;
+        m_isPersistent = false;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_fences.Resize(regionCount);
+    for (auto& fence : m_fences)
+        fence = nullptr;
+    m_currentRegion = 0;
+    m_offset = 0;
+    return true;
+}
+
+
+void StreamingBuffer::Destroy(void) {
+    for (auto& fence : m_fences)
+        if (fence)
+            glDeleteSync(fence);
+    m_fences.Destroy();
+    if (m_handle) {
+        if (m_data) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_handle);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            m_data = nullptr;
+        }
+        glDeleteBuffers(1, &m_handle);
+        m_handle = 0;
+    }
+    m_isAvailable = false;
+    m_isStreaming = false;
+    m_isPersistent = false;
+}
+
+
+bool StreamingBuffer::Allocate(const void* data, size_t dataSize, size_t& offset) {
+    if (not m_isStreaming or (dataSize > m_regionSize))
+        return false;
+    if (m_offset + dataSize > m_regionSize) {
+        ++m_stats.overflowCount;
+        NextRegion();
+    }
+    offset = size_t(m_currentRegion) * m_regionSize + m_offset;
+    if (m_isPersistent)
+        memcpy(m_data + offset, data, dataSize);
+    else {
+        // the region hasn't been written since the buffer was last orphaned, so the GPU isn't reading it
+        glBindBuffer(GL_ARRAY_BUFFER, m_handle);
+        void* bufferData = glMapBufferRange(GL_ARRAY_BUFFER, GLintptr(offset), GLsizeiptr(dataSize), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (not bufferData)
+            return false;
+        memcpy(bufferData, data, dataSize);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    m_offset = (m_offset + dataSize + alignment - 1) & ~(alignment - 1);
+    m_stats.bytesStreamed += dataSize;
+    ++m_stats.allocationCount;
+    return true;
+}
+
+
+void StreamingBuffer::Update(void) {
+    if (m_isStreaming and (m_offset > 0))
+        NextRegion();
+}
+
+
+void StreamingBuffer::NextRegion(void) {
+    if (m_isPersistent)
+        m_fences[m_currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_currentRegion = (m_currentRegion + 1) % RegionCount();
+    m_offset = 0;
+    if (m_isPersistent)
+        WaitForRegion(m_currentRegion);
+    else if (m_currentRegion == 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_handle);
+        glBufferData(GL_ARRAY_BUFFER, m_regionSize * size_t(RegionCount()), nullptr, GL_STREAM_DRAW);
+        ++m_stats.orphanCount;
+    }
+}
+
+
+void StreamingBuffer::WaitForRegion(int region) {
+    GLsync& fence = m_fences[region];
+    if (not fence)
+        return;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        ++m_stats.stallCount;
+        auto t0 = std::chrono::steady_clock::now();
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+        m_stats.stallTime += std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+
+void StreamingBuffer::ReportStats(void) {
+    fprintf(stderr, "vertex streaming (%s): %zu bytes in %d allocations, %d overflows, %d orphans, %d stalls (%1.2f ms)\n",
+            m_isPersistent ? "persistent mapping" : "orphaning", m_stats.bytesStreamed, m_stats.allocationCount, m_stats.overflowCount,
+            m_stats.orphanCount, m_stats.stallCount, 1000.0f * m_stats.stallTime);
+}
+
+// =================================================================================================
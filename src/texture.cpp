@@ -1,6 +1,12 @@
 #include <utility>
+#include <algorithm>
 #include <stdio.h>
 #include "texture.h"
+#include "textureuploader.h"
+#include "pixelkernels.h"
+#include "texturebindings.h"
+#include "workerpool.h"
+#include "blockencoder.h"
 #include "SDL_image.h"
 
 // =================================================================================================
@@ -24,6 +30,11 @@ TextureBuffer::TextureBuffer(TextureBuffer&& other) noexcept {
 
 void TextureBuffer::Reset(void) {
     m_info.Reset();
+    m_source.reset();
+    m_mappedData = nullptr;
+    m_levelCount = 1;
+    m_encodedData.clear();
+    m_dirtyRects.clear();
 #if USE_SHARED_POINTERS
     m_data.Release();
 #else
@@ -35,30 +46,30 @@ void TextureBuffer::Reset(void) {
 void TextureBuffer::FlipSurface(SDL_Surface* source)
 {
     SDL_LockSurface(source);
-    int pitch = source->pitch; // row size
-    int h = source->h;
-    char* pixels = (char*)source->pixels + h * pitch;
-    char* dataPtr = (char*)m_data;
-
-    for (int i = 0; i < h; i++) {
-        pixels -= pitch;
-        memcpy(dataPtr, pixels, pitch);
-        dataPtr += pitch;
-    }
+    PixelKernels::Copy((uint8_t*)(char*)m_data, (const uint8_t*)source->pixels, m_info.width, m_info.height, source->pitch, m_info.componentCount, true);
     SDL_UnlockSurface(source);
 }
 
 
+// RGB, RGBA and palettized images (which includes grey scale images) are converted by the pixel kernels directly
+// into the texture buffer, handling flipping and padded rows on the fly. Other pixel formats are converted to
+// RGBA by SDL first.
 TextureBuffer& TextureBuffer::Create(SDL_Surface* source, bool flipVertically) {
-    m_info.width = source->w;
-    m_info.height = source->h;
-    m_info.componentCount = source->pitch / source->w;
-    if (m_info.componentCount < 3) {
+    Uint32 format = source->format->format;
+    bool isPalettized = (format == SDL_PIXELFORMAT_INDEX8) and (source->format->palette != nullptr);
+    if (not (isPalettized or (format == SDL_PIXELFORMAT_RGB24) or (format == SDL_PIXELFORMAT_RGBA32))) {
         SDL_Surface* h = source;
         source = SDL_ConvertSurfaceFormat(source, SDL_PIXELFORMAT_RGBA32, 0);
         SDL_FreeSurface(h);
-        m_info.componentCount = source->pitch / source->w;
+        if (not source) {
+            fprintf(stderr, "%s (%d): texture format conversion failed (%s)\n", __FILE__, __LINE__, SDL_GetError());
+            return *this;
+        }
+        format = SDL_PIXELFORMAT_RGBA32;
     }
+    m_info.width = source->w;
+    m_info.height = source->h;
+    m_info.componentCount = ((format == SDL_PIXELFORMAT_RGB24) and not expandRGB) ? 3 : 4;
     m_info.internalFormat = (m_info.componentCount == 4) ? GL_RGBA : GL_RGB;
     m_info.format = (m_info.componentCount == 4) ? GL_RGBA : GL_RGB;
     m_info.dataSize = m_info.width * m_info.height * m_info.componentCount;
@@ -70,12 +81,30 @@ TextureBuffer& TextureBuffer::Create(SDL_Surface* source, bool flipVertically) {
     if (not m_data) // malloc(m_dataSize);
         fprintf(stderr, "%s (%d): memory allocation for texture clone failed\n", __FILE__, __LINE__);
     else {
-        if (flipVertically)
-            FlipSurface(source);
+        uint8_t* data = (uint8_t*)(char*)m_data;
+        SDL_LockSurface(source);
+        const uint8_t* pixels = (const uint8_t*)source->pixels;
+        if (isPalettized) {
+            uint32_t palette[256] = {};
+            SDL_Palette* sourcePalette = source->format->palette;
+            for (int i = 0; (i < sourcePalette->ncolors) and (i < 256); i++)
+                memcpy(palette + i, sourcePalette->colors + i, 4);
+            Uint32 colorKey;
+            if ((SDL_GetColorKey(source, &colorKey) == 0) and (colorKey < 256))
+                ((uint8_t*)(palette + colorKey))[3] = 0;
+            PixelKernels::ExpandPalette(data, pixels, palette, m_info.width, m_info.height, source->pitch, flipVertically, premultiplyAlpha);
+        }
+        else if (format == SDL_PIXELFORMAT_RGB24) {
+            if (expandRGB)
+                PixelKernels::ExpandRGB(data, pixels, m_info.width, m_info.height, source->pitch, flipVertically);
+            else
+                PixelKernels::Copy(data, pixels, m_info.width, m_info.height, source->pitch, 3, flipVertically);
+        }
         else
-            memcpy(m_data, source->pixels, m_info.dataSize);
-        SDL_FreeSurface(source);
+            PixelKernels::Copy(data, pixels, m_info.width, m_info.height, source->pitch, 4, flipVertically, premultiplyAlpha);
+        SDL_UnlockSurface(source);
     }
+    SDL_FreeSurface(source);
     return *this;
 }
 
@@ -91,16 +120,210 @@ TextureBuffer& TextureBuffer::operator= (TextureBuffer&& other) {
 TextureBuffer& TextureBuffer::Copy(TextureBuffer& other) {
     m_info = other.m_info;
     m_data = other.m_data;
+    m_source = other.m_source;
+    m_mappedData = other.m_mappedData;
+    m_levelCount = other.m_levelCount;
+    m_encodedData = other.m_encodedData;
+    m_dirtyRects = other.m_dirtyRects;
     return *this;
 }
 
 TextureBuffer& TextureBuffer::Move(TextureBuffer& other) {
     m_info = other.m_info;
     m_data = std::move(other.m_data);
+    m_source = std::move(other.m_source);
+    m_mappedData = other.m_mappedData;
+    m_levelCount = other.m_levelCount;
+    m_encodedData = std::move(other.m_encodedData);
+    m_dirtyRects = std::move(other.m_dirtyRects);
     other.Reset();
     return *this;
 }
 
+TextureBuffer& TextureBuffer::Map(std::shared_ptr<TextureFile> source, int imageIndex) {
+    const TextureFile::Header* header = source->m_header;
+    m_info.width = int(header->width);
+    m_info.height = int(header->height);
+    m_info.componentCount = int(header->componentCount);
+    m_info.format = (m_info.componentCount == 4) ? GL_RGBA : GL_RGB;
+    if (header->isCompressed)
+        m_info.internalFormat = (m_info.componentCount == 4) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    else
+        m_info.internalFormat = m_info.format;
+    m_levelCount = int(header->levelCount);
+    m_info.dataSize = int(TextureFile::LevelSize(m_info.width, m_info.height, m_info.componentCount, IsCompressed()));
+    m_mappedData = source->ImageData(imageIndex);
+    m_source = std::move(source);
+    return *this;
+}
+
+void TextureBuffer::ReleaseData(void) {
+#if USE_SHARED_POINTERS
+    m_data.Release();
+#else
+    delete[] m_data;
+    m_data = nullptr;
+#endif
+    m_source.reset();
+    m_mappedData = nullptr;
+}
+
+
+bool TextureBuffer::Decode(bool flipVertically) {
+    if (m_encodedData.empty())
+        return false;
+    SDL_Surface* image = IMG_Load_RW(SDL_RWFromConstMem(m_encodedData.data(), int(m_encodedData.size())), 1);
+    if (not image)
+        return false;
+    Create(image, flipVertically);
+    return HasData();
+}
+
+
+bool TextureBuffer::CreateMipChain(void) {
+    if (m_levelCount > 1)
+        return true;
+    if (IsCompressed() or m_mappedData or not m_data)
+        return false;
+    int w = m_info.width, h = m_info.height, c = m_info.componentCount;
+    int levelCount = Texture::MipLevelCount(w, h);
+    if (levelCount == 1)
+        return true;
+    int dataSize = int(TextureFile::ChainSize(w, h, c, levelCount));
+#if USE_SHARED_POINTERS
+    SharedPointer<char> chain(dataSize);
+#else
+    char* chain = new char[dataSize];
+#endif
+    if (not chain) {
+        fprintf(stderr, "%s (%d): memory allocation for mip chain failed\n", __FILE__, __LINE__);
+        return false;
+    }
+    memcpy((char*)chain, (const char*)m_data, TextureFile::LevelSize(w, h, c));
+    TextureFile::CreateMipChain((uint8_t*)(char*)chain, w, h, c, levelCount, gammaCorrectMipMaps);
+#if USE_SHARED_POINTERS
+    m_data = chain;
+#else
+    delete[] m_data;
+    m_data = chain;
+#endif
+    m_levelCount = levelCount;
+    return true;
+}
+
+
+// OpenGL cannot generate mip maps for compressed textures, so the mip chain is computed before compressing
+bool TextureBuffer::Compress(void) {
+    if (IsCompressed() or not CreateMipChain())
+        return false;
+    int w = m_info.width, h = m_info.height, c = m_info.componentCount;
+    int levelCount = m_levelCount;
+    const uint8_t* pixels = (const uint8_t*)(char*)m_data;
+    int dataSize = int(TextureFile::ChainSize(w, h, c, levelCount, true));
+#if USE_SHARED_POINTERS
+    SharedPointer<char> blocks(dataSize);
+#else
+    char* blocks = new char[dataSize];
+#endif
+    if (not blocks) {
+        fprintf(stderr, "%s (%d): memory allocation for texture compression failed\n", __FILE__, __LINE__);
+        return false;
+    }
+    uint8_t* dest = (uint8_t*)(char*)blocks;
+    for (int i = 0; i < levelCount; i++) {
+        BlockEncoder::Encode(dest, pixels, w, h, c);
+        pixels += TextureFile::LevelSize(w, h, c);
+        dest += TextureFile::LevelSize(w, h, c, true);
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+#if USE_SHARED_POINTERS
+    m_data = blocks;
+#else
+    delete[] m_data;
+    m_data = blocks;
+#endif
+    m_levelCount = levelCount;
+    m_info.internalFormat = (c == 4) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    m_info.dataSize = int(TextureFile::LevelSize(m_info.width, m_info.height, c, true));
+    return true;
+}
+
+
+// Two regions are merged if the merged region is at most twice as large as both together, which e.g. combines
+// the glyphs of a line of text. If there are too many regions, the new one is merged with the region that grows least.
+void TextureBuffer::MarkDirty(int x, int y, int width, int height) {
+    DirtyRect rect = { std::max(x, 0), std::max(y, 0), std::min(x + width, m_info.width), std::min(y + height, m_info.height) };
+    if ((rect.left >= rect.right) or (rect.top >= rect.bottom))
+        return;
+    auto Merge = [](const DirtyRect& a, const DirtyRect& b) {
+        return DirtyRect{ std::min(a.left, b.left), std::min(a.top, b.top), std::max(a.right, b.right), std::max(a.bottom, b.bottom) };
+        };
+    // a merged region may in turn be close enough to other regions
+    for (size_t i = 0; i < m_dirtyRects.size(); ) {
+        DirtyRect merged = Merge(rect, m_dirtyRects[i]);
+        if (merged.Area() <= 2 * (rect.Area() + m_dirtyRects[i].Area())) {
+            rect = merged;
+            m_dirtyRects.erase(m_dirtyRects.begin() + i);
+            i = 0;
+        }
+        else
+            ++i;
+    }
+    if (int(m_dirtyRects.size()) < maxDirtyRects) {
+        m_dirtyRects.push_back(rect);
+        return;
+    }
+    DirtyRect* best = nullptr;
+    int minGrowth = 0;
+    for (auto& r : m_dirtyRects) {
+        int growth = Merge(rect, r).Area() - r.Area();
+        if (not best or (growth < minGrowth)) {
+            best = &r;
+            minGrowth = growth;
+        }
+    }
+    *best = Merge(rect, *best);
+}
+
+
+// Mapped texture data is read only, so the first write copies level 0 of it. Written data invalidates the mip chain, so
+// the mip maps are generated by OpenGL from then on.
+bool TextureBuffer::Write(int x, int y, int width, int height, const void* pixels, int pitch) {
+    if (IsCompressed() or not HasData() or (x < 0) or (y < 0) or (width <= 0) or (height <= 0) or (x + width > m_info.width) or (y + height > m_info.height))
+        return false;
+    int componentCount = m_info.componentCount;
+    if (m_mappedData) {
+        int dataSize = int(TextureFile::LevelSize(m_info.width, m_info.height, componentCount));
+#if USE_SHARED_POINTERS
+        SharedPointer<char> data(dataSize);
+#else
+        char* data = new char[dataSize];
+#endif
+        if (not data)
+            return false;
+        memcpy((char*)data, m_mappedData, size_t(dataSize));
+        m_data = data;
+        m_mappedData = nullptr;
+        m_source.reset();
+    }
+    m_levelCount = 1;
+    size_t rowSize = size_t(width) * size_t(componentCount);
+    if (pitch == 0)
+        pitch = int(rowSize);
+    const char* source = (const char*)pixels;
+    char* dest = (char*)m_data + (size_t(y) * size_t(m_info.width) + size_t(x)) * size_t(componentCount);
+    for (int i = 0; i < height; i++, source += pitch, dest += size_t(m_info.width) * size_t(componentCount))
+        memcpy(dest, source, rowSize);
+    MarkDirty(x, y, width, height);
+    return true;
+}
+
+
+size_t TextureBuffer::ResidentSize(void) {
+    return (HasData() ? DataSize() : 0) + m_encodedData.size();
+}
+
 // =================================================================================================
 
 bool Texture::Create(void) {
@@ -116,12 +339,16 @@ bool Texture::Create(void) {
 
 
 void Texture::Destroy(void) {
-#if USE_SHARED_HANDLES
-    m_handle.Release();
-#else
-    glDeleteTextures(1, &m_handle);
-    m_handle = 0;
-#endif
+    if (m_pendingUploads)
+        textureUploader.Cancel(this);
+    ReleaseHandle();
+    m_storage = TextureStorage();
+    m_isEvicted = false;
+    DeleteBuffers();
+}
+
+
+void Texture::DeleteBuffers(void) {
     TextureBuffer* texBuf = nullptr;
     for (const auto& p : m_buffers) {
         if (p != texBuf) {
@@ -143,6 +370,10 @@ Texture& Texture::Copy(const Texture& other) {
         m_type = other.m_type;
         m_wrapMode = other.m_wrapMode;
         m_useMipMaps = other.m_useMipMaps;
+        m_storage = other.m_storage;
+        m_residency = other.m_residency;
+        m_isFlipped = other.m_isFlipped;
+        m_deployedBuffer = other.m_deployedBuffer;
     }
     return *this;
 }
@@ -161,6 +392,11 @@ Texture& Texture::Move(Texture& other) {
         m_type = other.m_type;
         m_wrapMode = other.m_wrapMode;
         m_useMipMaps = other.m_useMipMaps;
+        m_storage = other.m_storage;
+        m_residency = other.m_residency;
+        m_isFlipped = other.m_isFlipped;
+        m_deployedBuffer = other.m_deployedBuffer;
+        other.m_storage = TextureStorage();
     }
     return *this;
 }
@@ -176,52 +412,130 @@ bool Texture::IsAvailable(void) {
 }
 
 
-void Texture::Bind(void) {
-    if (IsAvailable()) {
-        glEnable(GL_TEXTURE_2D);
-        glActiveTexture(GL_TEXTURE0);
+void Texture::ReleaseHandle(void) {
+    GLuint handle = GetHandle();
 #if USE_SHARED_HANDLES
-        glBindTexture(m_type, m_handle.get());
+    m_handle.Release();
+    // the handle may be shared (e.g. by texture copies or with an FBO buffer); only forget it once the GL texture is gone
+    if (handle and not glIsTexture(handle))
+        textureBindings.Forget(handle);
 #else
-        glBindTexture(m_type, m_handle);
+    glDeleteTextures(1, &m_handle);
+    m_handle = 0;
+    textureBindings.Forget(handle);
 #endif
-    }
+}
+
+
+// binds to the texture unit the texture has last been enabled on and makes that unit the active one
+void Texture::Bind(void) {
+    m_lastUsed = currentFrame;
+    if (m_isEvicted) // textures that are only ever bound, never enabled, must come back here
+        Restore();
+    if (IsAvailable())
+        textureBindings.Bind(m_tmu, m_type, GetHandle());
 }
 
 
 void Texture::Release(void) {
     if (IsAvailable())
-        glBindTexture(m_type, 0);
+        textureBindings.Release(m_tmu, m_type, GetHandle());
 }
 
 
 void Texture::SetParams(void) {
     if (m_useMipMaps) {
-        glTexParameteri(m_type, GL_GENERATE_MIPMAP, GL_TRUE);
         glTexParameteri(m_type, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(m_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
     else {
-        glTexParameteri(m_type, GL_GENERATE_MIPMAP, GL_FALSE);
         glTexParameteri(m_type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(m_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 }
 
 
 void Texture::Wrap(void) {
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, m_wrapMode);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, m_wrapMode);
+    glTexParameteri(m_type, GL_TEXTURE_WRAP_S, m_wrapMode);
+    glTexParameteri(m_type, GL_TEXTURE_WRAP_T, m_wrapMode);
+}
+
+
+// Texture parameters are part of the texture object's state, so they only need to be set when the texture object
+// doesn't have them yet. The texture bindings track them per texture object, since the handle can be replaced from
+// outside (e.g. by the renderer, which renders FBO buffers through a texture) and handles of deleted textures get reused.
+void Texture::ApplyParams(void) {
+    if (SamplerCache::IsAvailable())
+        return;
+    GLuint handle = GetHandle();
+    SamplerState state = GetSamplerState();
+    if (not textureBindings.HaveParams(handle, state)) {
+        SetParams();
+        Wrap();
+        textureBindings.SetParams(handle, state);
+    }
+}
+
+
+SamplerState Texture::GetSamplerState(void) {
+    SamplerState state;
+    state.minFilter = m_useMipMaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+    state.wrapS = state.wrapT = state.wrapR = m_wrapMode;
+    return state;
+}
+
+
+// m_useMipMaps and m_wrapMode may be changed at any time, so the sampler is looked up again when the state changes
+GLuint Texture::GetSampler(void) {
+    SamplerState state = GetSamplerState();
+    if ((m_sampler == 0) or (state != m_samplerState)) {
+        m_sampler = samplerCache.Get(state);
+        m_samplerState = state;
+    }
+    return m_sampler;
 }
 
 
 void Texture::Enable(int tmu) {
-    glActiveTexture(GL_TEXTURE0 + tmu);
-    glEnable(m_type);
+    m_tmu = tmu; // restoring and updating bind the texture to its unit
+    if (m_isEvicted)
+        Restore();
+    if (m_hasDirtyRegions)
+        UpdateDirtyRegions();
     Bind();
-    SetParams();
-    Wrap();
+    glEnable(m_type);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE); // texture environment is per unit state
+    if (SamplerCache::IsAvailable())
+        textureBindings.BindSampler(tmu, GetSampler());
+    else
+        ApplyParams();
+}
+
+
+// Textures that still need any GL setup are enabled one by one first, the rest are bound with a single call
+// where ARB_multi_bind is available. Doesn't enable fixed function texturing.
+void Texture::EnableTextures(TextureList& textures, int firstTmu) {
+    GLenum targets[TextureBindings::maxUnits];
+    GLuint handles[TextureBindings::maxUnits];
+    GLuint samplers[TextureBindings::maxUnits];
+    bool useSamplers = SamplerCache::IsAvailable();
+    int count = 0;
+    for (auto t : textures) {
+        int tmu = firstTmu + count;
+        if (tmu >= TextureBindings::maxUnits)
+            break;
+        if (t->m_isEvicted or t->m_hasDirtyRegions or not (useSamplers or textureBindings.HaveParams(t->GetHandle(), t->GetSamplerState())))
+            t->Enable(tmu);
+        t->m_tmu = tmu;
+        t->m_lastUsed = currentFrame;
+        targets[count] = t->m_type;
+        handles[count] = t->IsAvailable() ? t->GetHandle() : 0;
+        samplers[count] = useSamplers ? t->GetSampler() : 0;
+        ++count;
+    }
+    textureBindings.Bind(firstTmu, count, targets, handles);
+    if (useSamplers)
+        textureBindings.BindSamplers(firstTmu, count, samplers);
 }
 
 
@@ -231,12 +545,163 @@ void Texture::Disable(void) {
 }
 
 
-void Texture::Deploy(int bufferIndex) {
-    if (IsAvailable()) {
+GLenum Texture::SizedFormat(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_RGBA:
+            return GL_RGBA8;
+        case GL_RGB:
+            return GL_RGB8;
+        default:
+            return internalFormat;
+    }
+}
+
+
+// Allocate immutable storage incl. the full mip chain if mip mapping is enabled. Immutable storage cannot 
+// be reallocated, so if the image size or format changes, the texture gets a new handle.
+bool Texture::AllocateStorage(int width, int height, GLenum internalFormat) {
+    TextureStorage storage = { width, height, m_useMipMaps ? MipLevelCount(width, height) : 1, SizedFormat(internalFormat) };
+    if ((storage.width == m_storage.width) and (storage.height == m_storage.height) and (storage.levels == m_storage.levels) and (storage.internalFormat == m_storage.internalFormat))
+        return true;
+    if (HasImmutableStorage()) {
+        ReleaseHandle();
+#if USE_SHARED_HANDLES
+        m_handle = SharedTextureHandle();
+        if (not m_handle.Claim())
+            return false;
+#else
+        glGenTextures(1, &m_handle);
+        if (not m_handle)
+            return false;
+#endif
+    }
+    Bind();
+    glTexStorage2D(m_type, storage.levels, storage.internalFormat, width, height); // for cubemaps, allocates all six faces
+    Release();
+    m_storage = storage;
+    return true;
+}
+
+
+// data points to the mip chain of texBuf (or is an offset into the bound pixel unpack buffer)
+void Texture::UploadImage(GLenum target, TextureBuffer* texBuf, const void* data) {
+    int levelCount = m_useMipMaps ? texBuf->m_levelCount : 1;
+    if (HasImmutableStorage() and (levelCount > m_storage.levels))
+        levelCount = m_storage.levels;
+    int w = texBuf->m_info.width;
+    int h = texBuf->m_info.height;
+    bool isCompressed = texBuf->IsCompressed();
+    const char* levelData = (const char*)data;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < levelCount; level++) {
+        size_t levelSize = TextureFile::LevelSize(w, h, texBuf->m_info.componentCount, isCompressed);
+        if (isCompressed) {
+            if (HasImmutableStorage())
+                glCompressedTexSubImage2D(target, level, 0, 0, w, h, texBuf->m_info.internalFormat, GLsizei(levelSize), levelData);
+            else
+                glCompressedTexImage2D(target, level, texBuf->m_info.internalFormat, w, h, 0, GLsizei(levelSize), levelData);
+        }
+        else if (HasImmutableStorage())
+            glTexSubImage2D(target, level, 0, 0, w, h, texBuf->m_info.format, GL_UNSIGNED_BYTE, levelData);
+        else
+            glTexImage2D(target, level, texBuf->m_info.internalFormat, w, h, 0, texBuf->m_info.format, GL_UNSIGNED_BYTE, levelData);
+        levelData += levelSize;
+        w = (w > 1) ? w / 2 : 1;
+        h = (h > 1) ? h / 2 : 1;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+
+// textures loaded from cooked files may come with their mip chain
+void Texture::GenerateMipMaps(void) {
+    if (m_useMipMaps and (m_buffers.IsEmpty() or (m_buffers.First()->m_levelCount == 1)))
+        glGenerateMipmap(m_type);
+}
+
+
+// only 2D textures can upload changed regions (see UpdateRegion())
+bool Texture::Write(int x, int y, int width, int height, const void* pixels, int pitch, int bufferIndex) {
+    if ((m_type != GL_TEXTURE_2D) or (bufferIndex < 0) or (bufferIndex >= int(m_buffers.Length())) or not m_buffers[bufferIndex]->Write(x, y, width, height, pixels, pitch))
+        return false;
+    // other buffers aren't in the GL texture; deploying them uploads their changes
+    if (bufferIndex == m_deployedBuffer)
+        m_hasDirtyRegions = true;
+    return true;
+}
+
+
+// The unpack row length makes OpenGL read the region straight from the texture buffer. Textures with a pending
+// streaming upload are skipped, since that upload will contain the changes anyway.
+bool Texture::UpdateRegion(int x, int y, int width, int height, int bufferIndex) {
+    if ((m_type != GL_TEXTURE_2D) or m_isEvicted or m_pendingUploads or (GetHandle() == 0) or (bufferIndex < 0) or (bufferIndex >= int(m_buffers.Length())))
+        return false;
+    TextureBuffer* texBuf = m_buffers[bufferIndex];
+    if (texBuf->IsCompressed() or not texBuf->HasData())
+        return false;
+    x = std::max(x, 0);
+    y = std::max(y, 0);
+    width = std::min(width, texBuf->m_info.width - x);
+    height = std::min(height, texBuf->m_info.height - y);
+    if ((width <= 0) or (height <= 0))
+        return false;
+    size_t offset = (size_t(y) * size_t(texBuf->m_info.width) + size_t(x)) * size_t(texBuf->m_info.componentCount);
+    Bind();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, texBuf->m_info.width);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, texBuf->m_info.format, GL_UNSIGNED_BYTE, texBuf->Data() + offset);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    Release();
+    return true;
+}
+
+
+// All buffers of a 2D texture are uploaded to the same GL image, so only the deployed buffer's changes belong there
+int Texture::UpdateDirtyRegions(int bufferIndex) {
+    if (bufferIndex < 0)
+        bufferIndex = m_deployedBuffer;
+    if (bufferIndex >= int(m_buffers.Length()))
+        return 0;
+    int uploadCount = 0;
+    TextureBuffer* texBuf = m_buffers[bufferIndex];
+    std::vector<TextureBuffer::DirtyRect> failedRects;
+    for (auto& r : texBuf->m_dirtyRects) {
+        if (UpdateRegion(r.left, r.top, r.right - r.left, r.bottom - r.top, bufferIndex))
+            ++uploadCount;
+        else
+            failedRects.push_back(r);
+    }
+    texBuf->m_dirtyRects = std::move(failedRects);
+    if (bufferIndex == m_deployedBuffer)
+        m_hasDirtyRegions = texBuf->IsDirty();
+    if (m_useMipMaps and (uploadCount > 0)) {
         Bind();
-        SetParams();
+        glGenerateMipmap(m_type);
+        Release();
+    }
+    return uploadCount;
+}
+
+
+void Texture::Deploy(int bufferIndex) {
+    if (IsAvailable() and RestoreData()) {
         TextureBuffer* texBuf = m_buffers[bufferIndex];
-        glTexImage2D(m_type, 0, texBuf->m_info.internalFormat, texBuf->m_info.width, texBuf->m_info.height, 0, texBuf->m_info.format, GL_UNSIGNED_BYTE, texBuf->m_data);
+        if (UseImmutableStorage() and not AllocateStorage(texBuf->m_info.width, texBuf->m_info.height, texBuf->m_info.internalFormat))
+            return;
+        // the entire buffer is uploaded, including its changes
+        m_deployedBuffer = bufferIndex;
+        texBuf->ClearDirtyRects();
+        m_hasDirtyRegions = false;
+        Bind();
+        ApplyParams();
+        if (textureUploader.IsStreaming())
+            textureUploader.Enqueue(this, m_type, texBuf);
+        else {
+            UploadImage(m_type, texBuf, texBuf->Data());
+            GenerateMipMaps();
+            ApplyResidency();
+        }
         Release();
     }
 }
@@ -253,42 +718,94 @@ void Texture::Deploy(int bufferIndex) {
 // It allows to pass a single texture which it will use for all faces of the cubemap
 
 bool Texture::Load(List<String>& fileNames, bool flipVertically) {
+    m_isFlipped = flipVertically;
+    if (LoadCooked(fileNames, flipVertically))
+        return true;
     // load texture from file
     m_filenames = fileNames;
     m_name = fileNames.First();
+    if (fileNames.First().IsEmpty()) // fileNames[0] must always contain a valid filename of an existing texture file
+        throw std::runtime_error("Texture::Load: missing texture names");
+    // decode all image files first, then assign them to the texture buffers
+    std::vector<String> names;
+    for (auto& fileName : fileNames)
+        names.push_back(fileName);
+    int fileCount = int(names.size());
+    std::vector<TextureBuffer*> images(fileCount, nullptr);
+    if (m_parallelDecode and (fileCount > 1))
+        workerPool.ParallelFor(fileCount, [&](int i) {
+            if (not names[i].IsEmpty())
+                images[i] = LoadImage(names[i], flipVertically);
+            });
+    else {
+        for (int i = 0; i < fileCount; i++) {
+            if (not names[i].IsEmpty() and not (images[i] = LoadImage(names[i], flipVertically)))
+                break;
+        }
+    }
+    bool isLoaded = true;
     TextureBuffer* texBuf = nullptr;
-#ifdef _DEBUG
-    String bufferName = "";
-#endif
-    for (auto& fileName : fileNames) {
-        if (fileName.IsEmpty()) { // must never be true for first filename
-            if (not texBuf) // must always be true here -> fileNames[0] must always contain a valid filename of an existing texture file
-                throw std::runtime_error("Texture::Load: missing texture names");
-            else {
-                m_buffers.Append(texBuf);
-#ifdef _DEBUG
-                texBuf->m_name = bufferName;
-#endif
+    for (int i = 0; i < fileCount; i++) {
+        if (not names[i].IsEmpty()) {
+            if (not (isLoaded and images[i])) {
+                isLoaded = false;
+                delete images[i];
+                continue;
             }
+            texBuf = images[i];
         }
-        else {
+        if (isLoaded)
+            m_buffers.Append(texBuf);
+    }
+    return isLoaded;
+}
+
+
+// Doesn't change the texture, so several images of a texture can be loaded in parallel
+TextureBuffer* Texture::LoadImage(String& fileName, bool flipVertically) {
+    std::vector<char> encodedData;
+    SDL_Surface* image = ((m_residency == Residency::KeepCompressed) and ReadFile(fileName, encodedData))
+                         ? IMG_Load_RW(SDL_RWFromConstMem(encodedData.data(), int(encodedData.size())), 1)
+                         : IMG_Load(fileName.Data());
+    if (not image) {
+        fprintf(stderr, "Couldn't find '%s'\n", (char*)(fileName));
+        return nullptr;
+    }
+    TextureBuffer* texBuf = new TextureBuffer();
+    texBuf->Create(image, flipVertically);
+    PrepareBuffer(texBuf);
+    texBuf->m_encodedData = std::move(encodedData);
 #ifdef _DEBUG
-            bufferName = fileName;
+    texBuf->m_name = fileName;
 #endif
-            SDL_Surface* image = IMG_Load(fileName.Data());
-            if (not image) {
-                fprintf(stderr, "Couldn't find '%s'\n", (char*)(fileName));
-                return false;
-            }
+    return texBuf;
+}
+
+
+// Buffers share the mapping of the cooked file. Consecutive buffers using the same image share their TextureBuffer
+// just like buffers loaded from image files.
+bool Texture::LoadCooked(List<String>& fileNames, bool flipVertically) {
+    if (fileNames.IsEmpty() or fileNames.First().IsEmpty())
+        return false;
+    std::shared_ptr<TextureFile> textureFile = std::make_shared<TextureFile>();
+    if (not (textureFile->Open(TextureFile::CookedFileName(fileNames)) and textureFile->Matches(fileNames, flipVertically)))
+        return false;
+    if (textureFile->m_header->isCompressed and not HaveCompression()) // load the image files instead
+        return false;
+    m_filenames = fileNames;
+    m_name = fileNames.First();
+    TextureBuffer* texBuf = nullptr;
+    int imageIndex = -1;
+    for (int i = 0; i < textureFile->BufferCount(); i++) {
+        if (textureFile->ImageIndex(i) != imageIndex) {
+            imageIndex = textureFile->ImageIndex(i);
             texBuf = new TextureBuffer();
-            if (texBuf) {
-                texBuf->Create(image, flipVertically);
-                m_buffers.Append(texBuf);
+            texBuf->Map(textureFile, imageIndex);
 #ifdef _DEBUG
-                texBuf->m_name = bufferName;
+            texBuf->m_name = fileNames[i];
 #endif
-            }
         }
+        m_buffers.Append(texBuf);
     }
     return true;
 }
@@ -306,6 +823,128 @@ bool Texture::CreateFromFile(List<String>& fileNames, bool flipVertically) {
 }
 
 
+// CPU side processing of decoded texture data
+void Texture::PrepareBuffer(TextureBuffer* texBuf) {
+    if (useCpuMipMaps)
+        texBuf->CreateMipChain();
+    if (UseCompression())
+        texBuf->Compress();
+}
+
+
+bool Texture::ReadFile(String& fileName, std::vector<char>& data) {
+    SDL_RWops* file = SDL_RWFromFile(fileName.Data(), "rb");
+    if (not file)
+        return false;
+    Sint64 size = SDL_RWsize(file);
+    if (size > 0) {
+        data.resize(size_t(size));
+        if (SDL_RWread(file, data.data(), 1, size_t(size)) != size_t(size))
+            data.clear();
+    }
+    SDL_RWclose(file);
+    return not data.empty();
+}
+
+
+// Textures can only release their data if they can restore it from their source files
+void Texture::ApplyResidency(void) {
+    if ((m_residency == Residency::Keep) or m_filenames.IsEmpty())
+        return;
+    TextureBuffer* texBuf = nullptr;
+    for (const auto& p : m_buffers) {
+        if (p != texBuf) {
+            texBuf = p;
+            p->ReleaseData();
+        }
+    }
+}
+
+
+bool Texture::IsResident(void) {
+    for (const auto& p : m_buffers)
+        if (not p->HasData())
+            return false;
+    return true;
+}
+
+
+// Decode the kept image file contents if there are any, otherwise load the texture again from its source files
+// (which may be cooked files). 
+bool Texture::RestoreData(void) {
+    if (IsResident())
+        return true;
+    bool isDecoded = true;
+    TextureBuffer* texBuf = nullptr;
+    for (const auto& p : m_buffers) {
+        if (p != texBuf) {
+            texBuf = p;
+            if (not (p->HasData() or p->Decode(m_isFlipped))) {
+                isDecoded = false;
+                break;
+            }
+            PrepareBuffer(p);
+        }
+    }
+    if (isDecoded)
+        return true;
+    List<String> fileNames = m_filenames;
+    DeleteBuffers();
+    if (Load(fileNames, m_isFlipped))
+        return true;
+    fprintf(stderr, "Couldn't reload texture '%s'\n", (char*)m_name);
+    return false;
+}
+
+
+size_t Texture::ResidentSize(void) {
+    size_t size = 0;
+    TextureBuffer* texBuf = nullptr;
+    for (const auto& p : m_buffers) {
+        if (p != texBuf) {
+            texBuf = p;
+            size += p->ResidentSize();
+        }
+    }
+    return size;
+}
+
+
+// Textures with pending uploads or texture data that cannot be restored are never evicted
+bool Texture::CanEvict(void) {
+    return not m_isEvicted and (m_pendingUploads == 0) and (GetHandle() != 0) and not m_buffers.IsEmpty() and (IsResident() or not m_filenames.IsEmpty());
+}
+
+
+bool Texture::Evict(void) {
+    if (not CanEvict())
+        return false;
+    ReleaseHandle();
+    m_storage = TextureStorage();
+    m_isEvicted = true;
+    return true;
+}
+
+
+// Deploy restores the texture data if the residency policy has released it
+bool Texture::Restore(void) {
+    if (not m_isEvicted)
+        return true;
+#if USE_SHARED_HANDLES
+    m_handle = SharedTextureHandle();
+    if (not m_handle.Claim())
+        return false;
+#else
+    glGenTextures(1, &m_handle);
+    if (not m_handle)
+        return false;
+#endif
+    m_isEvicted = false;
+    Deploy(m_deployedBuffer);
+    return true;
+}
+
+
 bool Texture::CreateFromSurface(SDL_Surface* surface, bool flipVertically) {
     if (not Create())
         return false;
@@ -314,6 +953,21 @@ bool Texture::CreateFromSurface(SDL_Surface* surface, bool flipVertically) {
 }
 
 
+// All cubemap faces have the same size, and faces sharing a buffer still occupy their own memory on the GPU.
+// A full mip chain adds a third.
+size_t Texture::MemorySize(void) {
+    if (m_buffers.IsEmpty())
+        return 0;
+    size_t size = 0;
+    if (m_type == GL_TEXTURE_CUBE_MAP)
+        size = 6 * size_t(m_buffers.First()->m_info.dataSize);
+    else
+        for (const auto& p : m_buffers)
+            size += size_t(p->m_info.dataSize);
+    return m_useMipMaps ? size + size / 3 : size;
+}
+
+
 tRenderOffsets Texture::ComputeOffsets(int w, int h, int viewportWidth, int viewportHeight, int renderAreaWidth, int renderAreaHeight)
 {
     if (renderAreaWidth == 0)
@@ -0,0 +1,156 @@
+#include "texturebindings.h"
+
+// =================================================================================================
+// Shadow copy of the textures bound to each texture unit
+
+void TextureBindings::SetActiveUnit(int tmu) {
+    if (m_activeUnit != tmu) {
+        glActiveTexture(GL_TEXTURE0 + tmu);
+        m_activeUnit = tmu;
+    }
+}
+
+
+void TextureBindings::Bind(int tmu, GLenum target, GLuint handle) {
+    if ((tmu < 0) or (tmu >= maxUnits))
+        return;
+    TextureUnit& unit = m_units[tmu];
+    SetActiveUnit(tmu); // also when skipping the bind: callers modify the texture on the active unit right after binding it
+    if (IsBound(tmu, target, handle)) {
+        unit.isReleased = false;
+        ++m_stats.skipCount;
+        return;
+    }
+    if ((handle == 0) and unit.isKnown and (unit.handle != 0) and (unit.target != target))
+        glBindTexture(unit.target, 0); // unbinding the texture bound to the unit rather than some other target
+    glBindTexture(target, handle);
+    unit.target = target;
+    unit.handle = handle;
+    unit.isReleased = false;
+    unit.isKnown = true;
+    ++m_stats.bindCount;
+}
+
+
+void TextureBindings::Bind(int firstUnit, int count, const GLenum* targets, const GLuint* handles) {
+    if (firstUnit + count > maxUnits)
+        count = maxUnits - firstUnit;
+    // only bind the range of units that actually change
+    int first = count, last = -1;
+    for (int i = 0; i < count; i++) {
+        if (IsBound(firstUnit + i, targets[i], handles[i])) {
+            m_units[firstUnit + i].isReleased = false;
+            ++m_stats.skipCount;
+        }
+        else {
+            if (first > i)
+                first = i;
+            last = i;
+        }
+    }
+    if (last < 0)
+        return;
+    if ((last == first) or not HaveMultiBind()) {
+        for (int i = first; i <= last; i++)
+            Bind(firstUnit + i, targets[i], handles[i]);
+        return;
+    }
+    glBindTextures(GLuint(firstUnit + first), GLsizei(last - first + 1), handles + first); // doesn't change the active unit
+    for (int i = first; i <= last; i++) {
+        TextureUnit& unit = m_units[firstUnit + i];
+        unit.target = targets[i];
+        unit.handle = handles[i];
+        unit.isReleased = false;
+        unit.isKnown = true;
+    }
+    ++m_stats.bindCount;
+    ++m_stats.multiBindCount;
+}
+
+
+void TextureBindings::BindSampler(int tmu, GLuint sampler) {
+    if ((tmu < 0) or (tmu >= maxUnits))
+        return;
+    TextureUnit& unit = m_units[tmu];
+    if (unit.isSamplerKnown and (unit.sampler == sampler))
+        return;
+    glBindSampler(GLuint(tmu), sampler);
+    unit.sampler = sampler;
+    unit.isSamplerKnown = true;
+    ++m_stats.samplerBindCount;
+}
+
+
+void TextureBindings::BindSamplers(int firstUnit, int count, const GLuint* samplers) {
+    if (firstUnit + count > maxUnits)
+        count = maxUnits - firstUnit;
+    int first = count, last = -1;
+    for (int i = 0; i < count; i++) {
+        TextureUnit& unit = m_units[firstUnit + i];
+        if (not (unit.isSamplerKnown and (unit.sampler == samplers[i]))) {
+            if (first > i)
+                first = i;
+            last = i;
+        }
+    }
+    if (last < 0)
+        return;
+    if ((last == first) or not HaveMultiBind()) {
+        for (int i = first; i <= last; i++)
+            BindSampler(firstUnit + i, samplers[i]);
+        return;
+    }
+    glBindSamplers(GLuint(firstUnit + first), GLsizei(last - first + 1), samplers + first);
+    for (int i = first; i <= last; i++) {
+        m_units[firstUnit + i].sampler = samplers[i];
+        m_units[firstUnit + i].isSamplerKnown = true;
+    }
+    ++m_stats.samplerBindCount;
+}
+
+
+void TextureBindings::Release(int tmu, GLenum target, GLuint handle) {
+    if ((tmu >= 0) and (tmu < maxUnits) and IsBound(tmu, target, handle))
+        m_units[tmu].isReleased = true;
+}
+
+
+void TextureBindings::Flush(void) {
+    for (int i = 0; i < maxUnits; i++)
+        if (m_units[i].isReleased)
+            Bind(i, m_units[i].target, 0);
+}
+
+
+void TextureBindings::Forget(GLuint handle) {
+    if (handle == 0)
+        return;
+    m_textureParams.erase(handle);
+    for (auto& unit : m_units) {
+        if (unit.handle == handle) {
+            unit.handle = 0;
+            unit.isReleased = false;
+        }
+    }
+}
+
+
+void TextureBindings::ForgetSamplers(void) {
+    for (auto& unit : m_units)
+        unit.sampler = 0;
+}
+
+
+void TextureBindings::Invalidate(void) {
+    for (auto& unit : m_units)
+        unit = { 0, 0, 0, false, false, false };
+    m_activeUnit = -1;
+}
+
+
+void TextureBindings::Update(void) {
+    m_frameStats = m_stats;
+    m_stats = BindStats();
+}
+
+// =================================================================================================
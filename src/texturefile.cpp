@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#   include <windows.h>
+#   include <sys/stat.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#include "texturefile.h"
+#include "texture.h"
+#include "blockencoder.h"
+#include "pixelkernels.h"
+#include "workerpool.h"
+#include "SDL_image.h"
+
+// =================================================================================================
+
+bool MappedFile::Open(const char* fileName) {
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    m_file = file;
+    LARGE_INTEGER size;
+    if (not GetFileSizeEx(file, &size) or (size.QuadPart == 0)) {
+        Close();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (not m_mapping) {
+        Close();
+        return false;
+    }
+    m_data = (const char*)MapViewOfFile((HANDLE)m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (not m_data) {
+        Close();
+        return false;
+    }
+    m_size = size_t(size.QuadPart);
+#else
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if ((fstat(fd, &info) < 0) or (info.st_size == 0)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file referenced
+    if (data == MAP_FAILED)
+        return false;
+    m_data = (const char*)data;
+    m_size = size_t(info.st_size);
+#endif
+    return true;
+}
+
+
+void MappedFile::Close(void) {
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle((HANDLE)m_mapping);
+    if (m_file)
+        CloseHandle((HANDLE)m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data)
+        munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+// =================================================================================================
+
+static const char* BaseName(const char* fileName) {
+    const char* baseName = fileName;
+    for (const char* p = fileName; *p; p++)
+        if ((*p == '/') or (*p == '\\'))
+            baseName = p + 1;
+    return baseName;
+}
+
+
+size_t TextureFile::LevelSize(int width, int height, int componentCount, bool isCompressed) {
+    return isCompressed ? BlockEncoder::CompressedSize(width, height, componentCount) : size_t(width) * size_t(height) * size_t(componentCount);
+}
+
+
+size_t TextureFile::ChainSize(int width, int height, int componentCount, int levelCount, bool isCompressed) {
+    size_t size = 0;
+    for (int i = 0; i < levelCount; i++) {
+        size += LevelSize(width, height, componentCount, isCompressed);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return size;
+}
+
+
+String TextureFile::CookedFileName(List<String>& fileNames) {
+    const char* fileName = (const char*)fileNames.First();
+    const char* extension = strrchr(BaseName(fileName), '.');
+    std::string cookedName = extension ? std::string(fileName, extension - fileName) : std::string(fileName);
+    if (fileNames.Length() > 1)
+        cookedName += "-" + std::to_string(fileNames.Length());
+    cookedName += ".rtx";
+    return String(cookedName.c_str());
+}
+
+
+bool TextureFile::Open(String fileName) {
+    if (not m_file.Open((const char*)fileName))
+        return false;
+    const char* data = m_file.Data();
+    size_t size = m_file.Size();
+    if (size < sizeof(Header))
+        return false;
+    m_header = (const Header*)data;
+    if (memcmp(m_header->magic, magic, sizeof(magic)) or (m_header->version != version) or
+        (m_header->componentCount < 3) or (m_header->componentCount > 4) or (m_header->levelCount < 1) or (m_header->imageCount < 1)) {
+        fprintf(stderr, "'%s' is not a valid cooked texture file\n", (const char*)fileName);
+        return false;
+    }
+    // Everything behind the header is checked against the file size before it is accessed. The size limits keep the
+    // 64 bit size computations below from overflowing.
+    const Header& header = *m_header;
+    if ((header.width < 1) or (header.width > maxImageSize) or (header.height < 1) or (header.height > maxImageSize) or
+        (header.levelCount > uint32_t(Texture::MipLevelCount(int(header.width), int(header.height)))) or
+        (header.bufferCount < 1) or (header.bufferCount > size) or (header.nameTableSize > size)) {
+        fprintf(stderr, "'%s' is not a valid cooked texture file\n", (const char*)fileName);
+        return false;
+    }
+    uint64_t headerSize = (sizeof(Header) + uint64_t(header.bufferCount) * (sizeof(uint32_t) + sizeof(SourceStamp)) + header.nameTableSize + 15) & ~uint64_t(15);
+    // the mip levels of each image follow each other, so all of them lie within the file if the last image ends in it
+    uint64_t imageSize = 0;
+    for (uint32_t i = 0, width = header.width, height = header.height; i < header.levelCount; i++) {
+        imageSize += LevelSize(int(width), int(height), int(header.componentCount), header.isCompressed != 0);
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+    imageSize = (imageSize + 15) & ~uint64_t(15);
+    if ((headerSize > size) or (uint64_t(header.imageCount) > (size - headerSize) / imageSize)) {
+        fprintf(stderr, "cooked texture file '%s' is truncated\n", (const char*)fileName);
+        return false;
+    }
+    m_imageIndices = (const uint32_t*)(data + sizeof(Header));
+    m_sources = (const char*)(m_imageIndices + m_header->bufferCount);
+    m_names = m_sources + m_header->bufferCount * sizeof(SourceStamp);
+    m_images = data + headerSize;
+    if (header.nameTableSize and m_names[header.nameTableSize - 1]) // the names are read as C strings
+        return false;
+    for (int i = 0; i < BufferCount(); i++)
+        if (m_imageIndices[i] >= m_header->imageCount)
+            return false;
+    return true;
+}
+
+
+TextureFile::SourceStamp TextureFile::GetSourceStamp(const char* fileName) {
+    if (not *fileName)
+        return SourceStamp{ 0, 0 };
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(fileName, &info))
+#else
+    struct stat info;
+    if (stat(fileName, &info))
+#endif
+        return SourceStamp{ 0, 0 };
+    return SourceStamp{ uint64_t(info.st_mtime), uint64_t(info.st_size) };
+}
+
+
+bool TextureFile::Matches(List<String>& fileNames, bool flipVertically) {
+    if ((m_header->isFlipped != uint32_t(flipVertically)) or (m_header->bufferCount != fileNames.Length()))
+        return false;
+    const char* name = m_names;
+    const char* nameTableEnd = m_names + m_header->nameTableSize;
+    const char* source = m_sources;
+    for (auto& f : fileNames) {
+        if ((name >= nameTableEnd) or strcmp(name, BaseName((const char*)f)))
+            return false;
+        name += strlen(name) + 1;
+        SourceStamp cookedStamp, stamp = GetSourceStamp((const char*)f);
+        memcpy(&cookedStamp, source, sizeof(cookedStamp)); // the stamps aren't 8 byte aligned in the file
+        if ((cookedStamp.modTime != stamp.modTime) or (cookedStamp.size != stamp.size))
+            return false;
+        source += sizeof(SourceStamp);
+    }
+    return true;
+}
+
+
+// Levels with enough rows are split into bands of rows which are filtered by the worker pool
+void TextureFile::CreateMipChain(uint8_t* chain, int width, int height, int componentCount, int levelCount, bool gammaCorrect) {
+    static constexpr int bandHeight = 32;
+    for (int i = 1; i < levelCount; i++) {
+        const uint8_t* level = chain;
+        uint8_t* nextLevel = chain + LevelSize(width, height, componentCount);
+        int w = std::max(1, width / 2);
+        int h = std::max(1, height / 2);
+        auto filterBand = [=](int band) {
+            int lastRow = std::min(h, (band + 1) * bandHeight);
+            for (int y = band * bandHeight; y < lastRow; y++) {
+                const uint8_t* row0 = level + size_t(std::min(2 * y, height - 1)) * width * componentCount;
+                const uint8_t* row1 = level + size_t(std::min(2 * y + 1, height - 1)) * width * componentCount;
+                PixelKernels::DownsampleRow(nextLevel + size_t(y) * w * componentCount, row0, row1, width, componentCount, gammaCorrect);
+            }
+            };
+        int bandCount = (h + bandHeight - 1) / bandHeight;
+        if (bandCount > 1)
+            workerPool.ParallelFor(bandCount, filterBand);
+        else
+            filterBand(0);
+        chain = nextLevel;
+        width = w;
+        height = h;
+    }
+}
+
+
+bool TextureFile::Cook(List<String>& fileNames, bool flipVertically, bool createMipMaps, bool compress) {
+    if (fileNames.IsEmpty() or fileNames.First().IsEmpty())
+        return false;
+    List<TextureBuffer*> images;
+    std::vector<uint32_t> imageIndices;
+    std::vector<SourceStamp> sources;
+    std::string names;
+    bool isValid = true;
+    for (auto& f : fileNames) {
+        names.append(BaseName((const char*)f));
+        names.push_back('\0');
+        sources.push_back(GetSourceStamp((const char*)f));
+        if (not f.IsEmpty()) {
+            SDL_Surface* image = IMG_Load((const char*)f);
+            if (not image) {
+                fprintf(stderr, "Couldn't find '%s'\n", (const char*)f);
+                isValid = false;
+                break;
+            }
+            TextureBuffer* texBuf = new TextureBuffer(image, flipVertically);
+            images.Append(texBuf);
+            TextureBuffer* first = images.First();
+            if ((texBuf->m_info.width != first->m_info.width) or (texBuf->m_info.height != first->m_info.height) or (texBuf->m_info.componentCount != first->m_info.componentCount)) {
+                fprintf(stderr, "'%s' differs in size or format from '%s'\n", (const char*)f, (const char*)fileNames.First());
+                isValid = false;
+                break;
+            }
+        }
+        imageIndices.push_back(uint32_t(images.Length() - 1));
+    }
+
+    if (isValid) {
+        TextureBuffer* first = images.First();
+        Header header = {
+            { magic[0], magic[1], magic[2], magic[3] }, version,
+            uint32_t(first->m_info.width), uint32_t(first->m_info.height), uint32_t(first->m_info.componentCount),
+            uint32_t(createMipMaps ? Texture::MipLevelCount(first->m_info.width, first->m_info.height) : 1),
+            uint32_t(images.Length()), uint32_t(imageIndices.size()), uint32_t(flipVertically), uint32_t(names.size()), uint32_t(compress)
+        };
+        size_t headerSize = sizeof(Header) + imageIndices.size() * (sizeof(uint32_t) + sizeof(SourceStamp)) + names.size();
+        std::vector<uint8_t> chain(AlignedSize(ChainSize(header.width, header.height, header.componentCount, header.levelCount)), 0);
+        std::vector<uint8_t> blocks(compress ? AlignedSize(ChainSize(header.width, header.height, header.componentCount, header.levelCount, true)) : 0, 0);
+        std::vector<uint8_t> padding(16, 0);
+        String cookedName = CookedFileName(fileNames);
+        FILE* file = fopen((const char*)cookedName, "wb");
+        if (not file) {
+            fprintf(stderr, "Couldn't create '%s'\n", (const char*)cookedName);
+            isValid = false;
+        }
+        else {
+            fwrite(&header, sizeof(header), 1, file);
+            fwrite(imageIndices.data(), sizeof(uint32_t), imageIndices.size(), file);
+            fwrite(sources.data(), sizeof(SourceStamp), sources.size(), file);
+            fwrite(names.data(), 1, names.size(), file);
+            fwrite(padding.data(), 1, AlignedSize(headerSize) - headerSize, file);
+            for (auto texBuf : images) {
+                int w = texBuf->m_info.width, h = texBuf->m_info.height, c = texBuf->m_info.componentCount;
+                memcpy(chain.data(), (const char*)texBuf->Data(), size_t(w) * h * c);
+                CreateMipChain(chain.data(), w, h, c, int(header.levelCount), TextureBuffer::gammaCorrectMipMaps);
+                if (not compress)
+                    fwrite(chain.data(), 1, chain.size(), file);
+                else {
+                    const uint8_t* level = chain.data();
+                    uint8_t* dest = blocks.data();
+                    for (uint32_t i = 0; i < header.levelCount; i++) {
+                        BlockEncoder::Encode(dest, level, w, h, c);
+                        level += LevelSize(w, h, c);
+                        dest += LevelSize(w, h, c, true);
+                        w = std::max(1, w / 2);
+                        h = std::max(1, h / 2);
+                    }
+                    fwrite(blocks.data(), 1, blocks.size(), file);
+                }
+            }
+            isValid = (ferror(file) == 0);
+            fclose(file);
+            if (not isValid) {
+                fprintf(stderr, "Couldn't write '%s'\n", (const char*)cookedName);
+                remove((const char*)cookedName);
+            }
+        }
+    }
+    for (auto texBuf : images)
+        delete texBuf;
+    return isValid;
+}
+
+// =================================================================================================
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <chrono>
+#include <climits>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
 #include "texturehandler.h"
+#include "workerpool.h"
 
 // =================================================================================================
 // Very simple class for texture tracking
@@ -11,6 +17,9 @@
 void TextureHandler::Destroy(void) {
     for (auto& t : m_textures) 
         delete t;
+    m_textures.Clear();
+    m_textureCache.Clear();
+    m_cacheKeys.Clear();
 }
 
 
@@ -32,6 +41,26 @@ bool TextureHandler::Remove(Texture* texture) {
 }
 
 
+bool TextureHandler::Release(Texture* texture) {
+    if (not texture)
+        return false;
+    String* key = m_cacheKeys.Find(texture);
+    if (key) {
+        CacheEntry* entry = m_textureCache.Find(*key);
+        if (entry and (--entry->refCount > 0))
+            return true;
+        if (entry)
+            m_cacheStats.bytesSaved += entry->hitCount * texture->MemorySize();
+        m_textureCache.Remove(*key);
+        m_cacheKeys.Remove(texture);
+    }
+    if (not m_textures.Remove(texture)) // not (or not anymore) owned by the texture handler
+        return false;
+    delete texture;
+    return true;
+}
+
+
 Cubemap* TextureHandler::GetCubemap(void) {
     Cubemap* t = new Cubemap();
     m_textures.Append(t);
@@ -39,45 +68,309 @@ Cubemap* TextureHandler::GetCubemap(void) {
 }
 
 
-TextureList TextureHandler::Create(String textureFolder, List<String>& textureNames, GLenum textureType) {
-    return (textureType == GL_TEXTURE_CUBE_MAP) ? CreateCubemaps (textureFolder, textureNames) : CreateTextures (textureFolder, textureNames);
+TextureList TextureHandler::Create(String textureFolder, List<String>& textureNames, GLenum textureType, bool flipVertically) {
+    return (textureType == GL_TEXTURE_CUBE_MAP) ? CreateCubemaps (textureFolder, textureNames, flipVertically) : CreateTextures (textureFolder, textureNames, flipVertically);
 }
 
 
-TextureList TextureHandler::CreateTextures(String textureFolder, List<String>& textureNames) {
-    TextureList textures;
+TextureList TextureHandler::CreateTextures(String textureFolder, List<String>& textureNames, bool flipVertically) {
+    List<List<String>> fileNames;
     for (auto& n : textureNames) {
-        Texture* t = GetTexture();
-        if (not t)
-            break;
-        textures.Append(t);
-        List<String> fileNames; // must be local here so it gets reset every loop iteration
-        fileNames.Append(textureFolder + n);
-        if (not t->CreateFromFile(fileNames))
-            break;
+        List<String> textureFileNames; // must be local here so it gets reset every loop iteration
+        textureFileNames.Append(textureFolder + n);
+        fileNames.Append(textureFileNames);
     }
-    return textures;
+    return CreateCached(fileNames, GL_TEXTURE_2D, flipVertically);
 }
 
 
-TextureList TextureHandler::CreateCubemaps(String textureFolder, List<String>& textureNames) {
-    TextureList textures;
-	List<String> fileNames;
+TextureList TextureHandler::CreateCubemaps(String textureFolder, List<String>& textureNames, bool flipVertically) {
+    List<List<String>> fileNames;
+	List<String> cubemapFileNames;
     for (auto& n : textureNames) {
-        Cubemap* t = GetCubemap ();
-        if (not t)
-            break;
+        cubemapFileNames.Append(textureFolder + n);
+        fileNames.Append(cubemapFileNames);
+    }
+    return CreateCached(fileNames, GL_TEXTURE_CUBE_MAP, flipVertically);
+}
+
+
+String TextureHandler::CacheKey(List<String>& fileNames, GLenum textureType, bool flipVertically) {
+    String key = String((textureType == GL_TEXTURE_CUBE_MAP) ? "C" : "T") + String(flipVertically ? "1" : "0");
+    for (auto& f : fileNames)
+        key = key + String("|") + f;
+    return key;
+}
+
+
+// Return cached textures where available and load the others. Textures are entered in the cache before they are 
+// loaded, so a texture requested twice in the same call is only loaded once.
+TextureList TextureHandler::CreateCached(List<List<String>>& fileNames, GLenum textureType, bool flipVertically) {
+    TextureList textures;
+    TextureList newTextures;
+    List<List<String>> newFileNames;
+    for (auto& f : fileNames) {
+        String key = CacheKey(f, textureType, flipVertically);
+        CacheEntry* entry = m_useTextureCache ? m_textureCache.Find(key) : nullptr;
+        Texture* t;
+        if (entry) {
+            t = entry->texture;
+            ++entry->refCount;
+            ++entry->hitCount;
+            ++m_cacheStats.hitCount;
+        }
+        else {
+            t = (textureType == GL_TEXTURE_CUBE_MAP) ? GetCubemap() : GetTexture();
+            if (not t)
+                break;
+            t->m_parallelDecode = m_parallelLoading and (textureType == GL_TEXTURE_CUBE_MAP); // decode the faces of a cubemap concurrently
+            newTextures.Append(t);
+            newFileNames.Append(f);
+            if (m_useTextureCache) {
+                m_textureCache.Insert(key, { t, 1, 0 });
+                m_cacheKeys.Insert(t, key);
+                ++m_cacheStats.missCount;
+            }
+        }
         textures.Append(t);
-        fileNames.Append(textureFolder + n);
-        if (not t->CreateFromFile(fileNames))
+    }
+    int failedIndex;
+    LoadTextures(newTextures, newFileNames, flipVertically, failedIndex);
+    if (failedIndex < 0)
+        return textures;
+    // Loading stopped at the texture that failed to load and textures behind it have been deleted. Trim the result list 
+    // the same way and don't keep any of these textures in the cache, so a later request will try to load them again.
+    for (int i = failedIndex; i < int(newTextures.Length()); i++) {
+        String* key = m_cacheKeys.Find(newTextures[i]);
+        if (key) {
+            m_textureCache.Remove(*key);
+            m_cacheKeys.Remove(newTextures[i]);
+        }
+    }
+    Texture* failedTexture = newTextures[failedIndex];
+    TextureList usableTextures;
+    bool isTrimmed = false;
+    for (auto t : textures) {
+        if (not isTrimmed) {
+            usableTextures.Append(t);
+            isTrimmed = (t == failedTexture);
+        }
+        else { // drop the references taken above for textures that are not handed out
+            String* key = m_cacheKeys.Find(t);
+            CacheEntry* entry = key ? m_textureCache.Find(*key) : nullptr;
+            if (entry)
+                --entry->refCount;
+        }
+    }
+    return usableTextures;
+}
+
+
+TextureHandler::CacheStats TextureHandler::GetCacheStats(void) {
+    CacheStats stats = m_cacheStats;
+    for (auto t : m_textures) {
+        String* key = m_cacheKeys.Find(t);
+        CacheEntry* entry = key ? m_textureCache.Find(*key) : nullptr;
+        if (entry)
+            stats.bytesSaved += entry->hitCount * t->MemorySize();
+    }
+    return stats;
+}
+
+
+TextureHandler::MemoryStats TextureHandler::GetMemoryStats(void) {
+    MemoryStats stats;
+    for (auto t : m_textures) {
+        stats.cpuBytes += t->ResidentSize();
+        if (not t->IsEvicted())
+            stats.gpuBytes += t->MemorySize();
+    }
+    stats.gpuBudget = m_gpuBudget;
+    stats.evictionCount = m_evictionCount;
+    return stats;
+}
+
+
+void TextureHandler::Update(void) {
+    EnforceBudget();
+    ++Texture::currentFrame;
+}
+
+
+// Textures used in the current frame are never evicted, so the budget can be exceeded if a single frame needs more.
+// Neither are textures sharing their GL texture with other textures: Evicting one would delete the GL texture
+// the others are still using. Shared GL textures only count once towards the budget.
+void TextureHandler::EnforceBudget(void) {
+    if (m_gpuBudget == 0)
+        return;
+    std::unordered_map<GLuint, int> handleUsers;
+    for (auto t : m_textures)
+        if (not t->IsEvicted() and t->GetHandle())
+            ++handleUsers[t->GetHandle()];
+    size_t gpuBytes = 0;
+    std::vector<Texture*> candidates;
+    for (auto t : m_textures) {
+        if (t->IsEvicted())
+            continue;
+        if (t->GetHandle() == 0) {
+            gpuBytes += t->MemorySize();
+            continue;
+        }
+        int& users = handleUsers[t->GetHandle()];
+        if (users == 0) // counted with the first texture using the handle
+            continue;
+        gpuBytes += t->MemorySize();
+        if (users > 1)
+            users = 0;
+        else if ((t->m_lastUsed < Texture::currentFrame) and t->CanEvict())
+            candidates.push_back(t);
+    }
+    if (gpuBytes <= m_gpuBudget)
+        return;
+    std::sort(candidates.begin(), candidates.end(), [](Texture* t1, Texture* t2) { return t1->m_lastUsed < t2->m_lastUsed; });
+    for (auto t : candidates) {
+        size_t size = t->MemorySize();
+        if (t->Evict()) {
+            gpuBytes -= size;
+            ++m_evictionCount;
+            if (gpuBytes <= m_gpuBudget)
+                break;
+        }
+    }
+}
+
+
+TextureList TextureHandler::CreateByType(String textureFolder, List<String>& textureNames, GLenum textureType, bool flipVertically) {
+    return Create (textureFolder, textureNames, textureType, flipVertically);
+}
+
+
+// Serial loading stops at the first texture that fails to load. The failed texture remains in the result list,
+// textures behind it are discarded. Batch loading produces the same list.
+TextureList TextureHandler::LoadTextures(TextureList& textures, List<List<String>>& fileNames, bool flipVertically, int& failedIndex) {
+    auto t0 = std::chrono::steady_clock::now();
+    TextureList loadedTextures;
+    failedIndex = -1;
+    if (m_parallelLoading)
+        loadedTextures = LoadBatch(textures, fileNames, flipVertically, failedIndex);
+    else {
+        int i = 0;
+        for (auto t : textures) {
+            loadedTextures.Append(t);
+            if (not t->CreateFromFile(fileNames[i], flipVertically)) {
+                failedIndex = i;
+                break;
+            }
+            ++i;
+        }
+    }
+    for (int i = int(loadedTextures.Length()); i < int(textures.Length()); i++) {
+        Remove(textures[i]);
+        delete textures[i];
+    }
+    m_loadStats.textureCount = int(loadedTextures.Length());
+    m_loadStats.loadTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+    m_loadStats.isParallel = m_parallelLoading;
+    return loadedTextures;
+}
+
+
+// Texture::Load only reads and converts image data and doesn't touch OpenGL, so it can run on worker threads.
+// Texture handles are created and texture data is deployed here on the GL thread.
+TextureList TextureHandler::LoadBatch(TextureList& textures, List<List<String>>& fileNames, bool flipVertically, int& failedIndex) {
+    struct LoadResult {
+        int     index;
+        bool    isLoaded;
+    };
+
+    CompletionQueue<LoadResult> loadResults;
+    int textureCount = 0;
+    for (auto t : textures) {
+        if (not t->Create())
+            break;
+        ++textureCount;
+    }
+    for (int i = 0; i < textureCount; i++) {
+        Texture* t = textures[i];
+        List<String>* textureFileNames = &fileNames[i];
+        workerPool.Submit([t, textureFileNames, i, flipVertically, &loadResults] {
+            bool isLoaded = false;
+            try {
+                isLoaded = textureFileNames->IsEmpty() or t->Load(*textureFileNames, flipVertically);
+            }
+            catch (std::exception& e) {
+                fprintf(stderr, "%s\n", e.what());
+            }
+            loadResults.Push({ i, isLoaded });
+            });
+    }
+    failedIndex = (textureCount < int(textures.Length())) ? textureCount : INT_MAX;
+    for (int i = 0; i < textureCount; i++) {
+        LoadResult result = loadResults.Pop();
+        if (not result.isLoaded)
+            failedIndex = std::min(failedIndex, result.index);
+        else if ((result.index < failedIndex) and not fileNames[result.index].IsEmpty())
+            textures[result.index]->Deploy();
+    }
+    TextureList loadedTextures;
+    for (int i = 0; i < int(textures.Length()); i++) {
+        loadedTextures.Append(textures[i]);
+        if (i == failedIndex)
             break;
     }
-    return textures;
+    if (failedIndex == INT_MAX)
+        failedIndex = -1;
+    return loadedTextures;
 }
 
 
-TextureList TextureHandler::CreateByType(String textureFolder, List<String>& textureNames, GLenum textureType) {
-    return Create (textureFolder, textureNames, textureType);
+void TextureHandler::BenchmarkLoading(String textureFolder, List<String>& textureNames, GLenum textureType) {
+    bool parallelLoading = m_parallelLoading;
+    bool useTextureCache = m_useTextureCache;
+    m_useTextureCache = false; // otherwise, the second pass would be served from the cache
+    float loadTimes[2] = { 0.0f, 0.0f };
+    // the first pass only warms up the file system cache so that neither of the timed passes benefits from it
+    for (int i = -1; i < 2; i++) {
+        m_parallelLoading = (i == 1);
+        TextureList textures = Create(textureFolder, textureNames, textureType);
+        if (i >= 0)
+            loadTimes[i] = m_loadStats.loadTime;
+        for (auto t : textures)
+            Release(t);
+    }
+    m_parallelLoading = parallelLoading;
+    m_useTextureCache = useTextureCache;
+    fprintf(stderr, "loading %d textures: serial %1.3f s, parallel %1.3f s (%d workers)\n",
+            int(textureNames.Length()), loadTimes[0], loadTimes[1], workerPool.WorkerCount());
+}
+
+
+// Load a single cubemap from faceNames with serial and parallel face decoding and print both load times.
+// Call it with six distinct faces and with two faces (five shared + one) to compare both upload paths.
+void TextureHandler::BenchmarkCubemap(String textureFolder, List<String>& faceNames) {
+    bool parallelLoading = m_parallelLoading;
+    bool useTextureCache = m_useTextureCache;
+    m_useTextureCache = false;
+    List<List<String>> fileNames;
+    List<String> cubemapFileNames;
+    for (auto& n : faceNames)
+        cubemapFileNames.Append(textureFolder + n);
+    fileNames.Append(cubemapFileNames);
+    float loadTimes[2] = { 0.0f, 0.0f };
+    for (int i = -1; i < 2; i++) {
+        m_parallelLoading = (i == 1);
+        auto t0 = std::chrono::steady_clock::now();
+        TextureList textures = CreateCached(fileNames, GL_TEXTURE_CUBE_MAP);
+        glFinish(); // include the upload
+        if (i >= 0)
+            loadTimes[i] = std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+        for (auto t : textures)
+            Release(t);
+    }
+    m_parallelLoading = parallelLoading;
+    m_useTextureCache = useTextureCache;
+    fprintf(stderr, "loading cubemap with %d faces: serial %1.3f s, parallel %1.3f s (%d workers)\n",
+            int(faceNames.Length()), loadTimes[0], loadTimes[1], workerPool.WorkerCount());
 }
 
 // =================================================================================================
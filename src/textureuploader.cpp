@@ -0,0 +1,154 @@
+#include <string.h>
+#include "textureuploader.h"
+
+// =================================================================================================
+// Streaming texture upload through a ring of pixel unpack buffers (PBOs).
+
+bool TextureUploader::Create(int bufferCount) {
+    Destroy();
+    m_isAvailable = GLEW_VERSION_2_1 or GLEW_ARB_pixel_buffer_object;
+    if (not m_isAvailable)
+        return false;
+    m_haveFences = GLEW_VERSION_3_2 or GLEW_ARB_sync;
+    m_pixelBuffers.Resize(bufferCount);
+    for (auto& pbo : m_pixelBuffers) {
+        glGenBuffers(1, &pbo.handle);
+        if (pbo.handle == 0) {
+            Destroy();
+            return m_isAvailable = false;
+        }
+    }
+    m_currentBuffer = 0;
+    return true;
+}
+
+
+void TextureUploader::Destroy(void) {
+    for (auto& pbo : m_pixelBuffers) {
+        if (pbo.fence)
+            glDeleteSync(pbo.fence);
+        if (pbo.handle)
+            glDeleteBuffers(1, &pbo.handle);
+    }
+    m_pixelBuffers.Destroy();
+    for (auto& request : m_requests)
+        --request.texture->m_pendingUploads;
+    m_requests.clear();
+    m_isAvailable = false;
+    m_isStreaming = false;
+}
+
+
+void TextureUploader::Enqueue(Texture* texture, GLenum target, TextureBuffer* buffer, int faceCount) {
+    m_requests.push_back({ texture, buffer, target, faceCount });
+    ++texture->m_pendingUploads;
+}
+
+
+void TextureUploader::Cancel(Texture* texture) {
+    for (auto it = m_requests.begin(); it != m_requests.end(); ) {
+        if (it->texture == texture)
+            it = m_requests.erase(it);
+        else
+            ++it;
+    }
+    texture->m_pendingUploads = 0;
+}
+
+
+// returns false if the GPU is still reading from pbo and we are not supposed to wait for it
+bool TextureUploader::WaitForBuffer(PixelBuffer& pbo, bool wait) {
+    if (not pbo.fence)
+        return true;
+    GLenum status = glClientWaitSync(pbo.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GLuint64(1000000000) : 0);
+    if ((status == GL_TIMEOUT_EXPIRED) or (status == GL_WAIT_FAILED))
+        return false;
+    glDeleteSync(pbo.fence);
+    pbo.fence = nullptr;
+    return true;
+}
+
+
+// Copy the texture data to the next PBO of the ring and have OpenGL read all faces of the request from there
+bool TextureUploader::Stage(UploadRequest& request, bool wait) {
+    PixelBuffer& pbo = m_pixelBuffers[m_currentBuffer];
+    if (not WaitForBuffer(pbo, wait)) {
+        ++m_stats.stallCount;
+        return false;
+    }
+    TextureBuffer* texBuf = request.buffer;
+    size_t dataSize = texBuf->DataSize();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.handle);
+    void* pboData;
+    if (m_haveFences and (pbo.capacity >= dataSize))
+        pboData = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    else { // grow or orphan the buffer
+        if (pbo.capacity < dataSize)
+            pbo.capacity = dataSize;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, pbo.capacity, nullptr, GL_STREAM_DRAW);
+        pboData = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    }
+    if (pboData) {
+        memcpy(pboData, texBuf->Data(), dataSize);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    else // mapping failed - fall back to a synchronous upload from client memory
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    Texture* texture = request.texture;
+    texture->Bind();
+    for (int i = 0; i < request.faceCount; i++)
+        texture->UploadImage(GLenum(request.target + i), texBuf, pboData ? nullptr : texBuf->Data());
+    texture->Release();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (pboData) {
+        if (m_haveFences)
+            pbo.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_currentBuffer = (m_currentBuffer + 1) % int(m_pixelBuffers.Length());
+    }
+    m_stats.bytesUploaded += dataSize;
+    ++m_stats.uploadCount;
+    return true;
+}
+
+
+bool TextureUploader::Upload(UploadRequest& request, bool wait) {
+    if (not Stage(request, wait))
+        return false;
+    Texture* texture = request.texture;
+    if (--texture->m_pendingUploads == 0) { // all faces of a cubemap are available now
+        texture->Bind();
+        texture->GenerateMipMaps();
+        texture->Release();
+        texture->ApplyResidency();
+    }
+    return true;
+}
+
+
+void TextureUploader::Update(void) {
+    m_stats = UploadStats();
+    if (not m_isAvailable)
+        return;
+    while (not m_requests.empty()) {
+        UploadRequest& request = m_requests.front();
+        // always upload at least one texture per frame, even if it alone exceeds the budget
+        if ((m_stats.uploadCount > 0) and (m_stats.bytesUploaded + request.buffer->DataSize() > m_frameBudget))
+            break;
+        if (not Upload(request, false)) // GPU still busy with the next PBO; retry next frame
+            break;
+        m_requests.pop_front();
+    }
+}
+
+
+void TextureUploader::Flush(void) {
+    if (not m_isAvailable)
+        return;
+    while (not m_requests.empty()) {
+        if (not Upload(m_requests.front(), true))
+            break;
+        m_requests.pop_front();
+    }
+}
+
+// =================================================================================================
@@ -4,7 +4,11 @@
 // =================================================================================================
 
 VAO* VAO::activeVAO = 0;
-List<VAO*> VAO::vaoStack;
+VAO* VAO::vaoStack[VAO::maxStackDepth];
+int VAO::stackDepth = 0;
+GLuint VAO::boundHandle = 0;
+VAO::BindStats VAO::bindStats;
+VAO::BindStats VAO::frameBindStats;
 
 // =================================================================================================
 // "Premium version of" OpenGL vertex array objects. CVAO instances offer methods to convert python
@@ -41,6 +45,9 @@ bool VAO::Init (GLuint shape) {
 
 void VAO::Destroy(void) {
     Disable();
+    // releasing the index buffer clears the element array buffer binding of whatever VAO is bound
+    if (IsValid())
+        BindVertexArray(0);
     for (auto& vbo : m_dataBuffers)
         vbo->Destroy();
     m_indexBuffer.Destroy();
@@ -99,7 +106,8 @@ bool VAO::UpdateBuffer(const char* type, void * data, size_t dataSize, size_t co
 }
 
 
-bool VAO::UpdateVertexBuffer(const char* type, void * data, size_t dataSize, size_t componentType, size_t componentCount) {
+bool VAO::UpdateVertexBuffer(const char* type, void * data, size_t dataSize, size_t componentType, size_t componentCount, int location,
+                             const std::vector<BufferRange>* dirtyRanges) {
     int index;
     VBO* vbo = FindBuffer(type, index);
     if (not vbo) { // otherwise index has been initialized by FindBuffer()
@@ -108,9 +116,43 @@ bool VAO::UpdateVertexBuffer(const char* type, void * data, size_t dataSize, siz
             return false;
         m_dataBuffers.Append(vbo);
         vbo->SetDynamic(m_isDynamic);
+        vbo->SetStreamed(m_isStreamed);
         index = m_dataBuffers.Length() - 1;
     }
-    vbo->Update(type, GL_ARRAY_BUFFER, index, data, dataSize, componentType, componentCount);
+    // Update() describes the attributes, which goes to whatever VAO is bound, and VAOs stay bound after Disable()
+    bool inactive = not IsActive();
+    bool unbound = not IsBound();
+    if (inactive or unbound)
+        Enable();
+    vbo->Update(type, GL_ARRAY_BUFFER, (location < 0) ? index : location, data, dataSize, componentType, componentCount, dirtyRanges);
+    if (inactive or unbound)
+        Disable();
+    return true;
+}
+
+
+bool VAO::UpdateInterleavedBuffer(const char* type, void* data, size_t dataSize, const VertexLayout& layout, const std::vector<BufferRange>* dirtyRanges) {
+    int index;
+    VBO* vbo = FindBuffer(type, index);
+    if (not vbo) {
+        vbo = new VBO();
+        if (not vbo)
+            return false;
+        m_dataBuffers.Append(vbo);
+        vbo->SetDynamic(m_isDynamic);
+        vbo->SetStreamed(m_isStreamed);
+    }
+    VertexLayout previousLayout = vbo->m_layout;
+    vbo->m_layout = layout;
+    if (not vbo->m_layout.Matches(previousLayout))
+        vbo->m_size = 0; // force reallocation, since the format of the data changes
+    bool inactive = not IsActive();
+    bool unbound = not IsBound();
+    if (inactive or unbound)
+        Enable();
+    vbo->Update(type, GL_ARRAY_BUFFER, -1, data, dataSize, GL_FLOAT, 0, dirtyRanges);
+    if (inactive or unbound)
+        Disable();
     return true;
 }
 
@@ -128,23 +170,20 @@ void VAO::UpdateIndexBuffer(void * data, size_t dataSize, size_t componentType)
 
 void VAO::Enable(void) {
     Activate();
-    if (not IsBound()) {
-#if USE_SHARED_HANDLES
-        glBindVertexArray(m_handle);
-        m_isBound = true;
-#else
-        glBindVertexArray(m_handle);
-#endif
-    }
+    BindVertexArray(m_handle);
 }
 
 
+// the VAO stays bound until a different one is enabled
 void VAO::Disable(void) {
     Deactivate();
-    if (IsBound()) {
-        glBindVertexArray(0);
-        m_isBound = false;
-    }
+}
+
+
+void VAO::ReportBindStats(void) {
+    int bindRequests = frameBindStats.bindCount + frameBindStats.skipCount;
+    fprintf(stderr, "VAO binds: %d of %d issued (%1.1f%% skipped)\n", frameBindStats.bindCount, bindRequests,
+            bindRequests ? 100.0f * float(frameBindStats.skipCount) / float(bindRequests) : 0.0f);
 }
 
 
@@ -1,8 +1,13 @@
+#include <stdio.h>
+
 #include "vbo.h"
+#include "streamingbuffer.h"
 
 // =================================================================================================
 // OpenGL vertex buffer handling: Creation, sending attributes to OpenGL, binding for rendering
 
+VBO::UploadStats VBO::uploadStats;
+
 // data: buffer with OpenGL data (float or unsigned int)
 // dataSize: buffer size in bytes
 // componentType: OpenGL type of OpenGL data components (GL_FLOAT or GL_UNSIGNED_INT)
@@ -23,6 +28,9 @@ VBO::VBO(const char* type, GLint bufferType, bool isDynamic) {
     m_componentCount = 0;
     m_componentType = 0;
     m_isDynamic = isDynamic;
+    m_isStreamed = false;
+    m_isInStream = false;
+    m_streamOffset = 0;
 }
 
 
@@ -33,7 +41,13 @@ size_t VBO::ComponentSize (size_t componentType) {
         case GL_UNSIGNED_INT:
             return 4;
         case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+        case GL_HALF_FLOAT:
             return 2;
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+        case GL_INT_2_10_10_10_REV:
+            return 1;
         default:
             return 4;
     }
@@ -53,6 +67,10 @@ VBO& VBO::Copy(VBO const& other) {
         m_componentCount = other.m_componentCount;
         m_componentType = other.m_componentType;
         m_isDynamic = other.m_isDynamic;
+        m_isStreamed = other.m_isStreamed;
+        m_isInStream = other.m_isInStream;
+        m_streamOffset = other.m_streamOffset;
+        m_layout = other.m_layout;
     }
     return *this;
 }
@@ -74,13 +92,20 @@ VBO& VBO::Move(VBO& other) {
         m_componentCount = other.m_componentCount;
         m_componentType = other.m_componentType;
         m_isDynamic = other.m_isDynamic;
+        m_isStreamed = other.m_isStreamed;
+        m_isInStream = other.m_isInStream;
+        m_streamOffset = other.m_streamOffset;
+        m_layout = std::move(other.m_layout);
         other.Reset();
     }
     return *this;
 }
 
 
-bool VBO::Update(const char* type, GLint bufferType, int index, void* data, size_t dataSize, size_t componentType, size_t componentCount) {
+bool VBO::Update(const char* type, GLint bufferType, int index, void* data, size_t dataSize, size_t componentType, size_t componentCount,
+                 const std::vector<BufferRange>* dirtyRanges) {
+    if (m_isStreamed and m_isDynamic and (bufferType == GL_ARRAY_BUFFER) and Stream(type, index, data, dataSize, componentType, componentCount))
+        return true;
     bool update;
 #if USE_SHARED_HANDLES
     if (m_handle.IsAvailable()) {
@@ -88,7 +113,7 @@ bool VBO::Update(const char* type, GLint bufferType, int index, void* data, size
     if (m_handle != 0)
 #endif
         if (m_isDynamic)
-            update = m_size == dataSize;
+            update = (m_size == dataSize) and (m_componentType == componentType) and not m_isInStream; // m_handle may hold stale data otherwise
         else {
             Bind();
             Describe();
@@ -106,27 +131,69 @@ bool VBO::Update(const char* type, GLint bufferType, int index, void* data, size
 
         update = false;
     }
-    if (not update) {
-        m_type = type;
-        m_bufferType = bufferType;
-        m_itemSize = ComponentSize(componentType) * componentCount;
-        m_itemCount = GLsizei(dataSize / m_itemSize);
-        m_componentType = GLenum(componentType);
-        m_componentCount = GLint(componentCount);
-    }
-    m_index = index;
+    if (not update)
+        SetFormat(type, bufferType, dataSize, componentType, componentCount);
+    m_index = m_layout.IsEmpty() ? index : -1;
     m_data = reinterpret_cast<char*>(data);
     m_size = GLsizei(dataSize);
+    m_isInStream = false;
+    m_streamOffset = 0;
     Bind();
-    if (m_isDynamic and update)
-        glBufferSubData(m_bufferType, 0, dataSize, data);
-    else
-        glBufferData(m_bufferType, dataSize, data, m_isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    uploadStats.bufferBytes += dataSize;
+    if (m_isDynamic and update and dirtyRanges and not dirtyRanges->empty()) {
+        for (auto& r : *dirtyRanges) {
+            glBufferSubData(m_bufferType, GLintptr(r.offset), GLsizeiptr(r.size), m_data + r.offset);
+            uploadStats.uploadedBytes += r.size;
+        }
+    }
+    else {
+        if (m_isDynamic and update)
+            glBufferSubData(m_bufferType, 0, dataSize, data);
+        else
+            glBufferData(m_bufferType, dataSize, data, m_isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+        uploadStats.uploadedBytes += dataSize;
+    }
+    Describe();
+    return true;
+}
+
+
+void VBO::SetFormat(const char* type, GLint bufferType, size_t dataSize, size_t componentType, size_t componentCount) {
+    m_type = type;
+    m_bufferType = bufferType;
+    m_itemSize = m_layout.IsEmpty() ? ComponentSize(componentType) * componentCount : size_t(m_layout.m_stride);
+    m_itemCount = GLsizei(dataSize / m_itemSize);
+    m_componentType = GLenum(componentType);
+    m_componentCount = GLint(componentCount);
+}
+
+
+// Copy the data to the streaming buffer and point the attributes at it. Nothing needs to be synchronized with
+// draw calls still using the data of previous updates, since these live elsewhere in the streaming buffer.
+bool VBO::Stream(const char* type, int index, void* data, size_t dataSize, size_t componentType, size_t componentCount) {
+    size_t offset;
+    if (not streamingBuffer.Allocate(data, dataSize, offset))
+        return false;
+    SetFormat(type, GL_ARRAY_BUFFER, dataSize, componentType, componentCount);
+    m_index = m_layout.IsEmpty() ? index : -1;
+    m_data = reinterpret_cast<char*>(data);
+    m_size = GLsizei(dataSize);
+    m_isInStream = true;
+    m_streamOffset = offset;
+    uploadStats.bufferBytes += dataSize;
+    uploadStats.uploadedBytes += dataSize;
+    glBindBuffer(GL_ARRAY_BUFFER, streamingBuffer.Handle());
     Describe();
     return true;
 }
 
 
+void VBO::ReportUploadStats(void) {
+    fprintf(stderr, "VBO uploads: %zu of %zu bytes (%1.1f%%)\n", uploadStats.uploadedBytes, uploadStats.bufferBytes,
+            uploadStats.bufferBytes ? 100.0f * float(uploadStats.uploadedBytes) / float(uploadStats.bufferBytes) : 0.0f);
+}
+
+
 void VBO::Destroy(void) {
     if (m_handle) {
         Release();
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "virtualtexture.h"
+#include "base_shaderhandler.h"
+#include "workerpool.h"
+
+// =================================================================================================
+// Software virtual texture
+
+// The cooked file must carry a mip chain and uncompressed pixels; otherwise the image is cooked (again)
+bool VirtualTexture::OpenSource(List<String>& fileNames, bool flipVertically) {
+    String cookedName = TextureFile::CookedFileName(fileNames);
+    for (int i = 0; i < 2; i++) {
+        m_source = std::make_shared<TextureFile>();
+        if (m_source->Open(cookedName) and m_source->Matches(fileNames, flipVertically) and (m_source->m_header->levelCount > 1) and not m_source->m_header->isCompressed)
+            return true;
+        m_source.reset(); // close the file before overwriting it
+        if ((i == 0) and not TextureFile::Cook(fileNames, flipVertically, true, false))
+            break;
+    }
+    fprintf(stderr, "VirtualTexture: couldn't load '%s'\n", (const char*)fileNames.First());
+    return false;
+}
+
+
+bool VirtualTexture::Create(List<String>& fileNames, bool flipVertically, int pageSize, int slotCount) {
+    Destroy();
+    if (fileNames.IsEmpty() or not OpenSource(fileNames, flipVertically))
+        return false;
+    m_name = fileNames.First();
+    const TextureFile::Header* header = m_source->m_header;
+    m_width = int(header->width);
+    m_height = int(header->height);
+    m_pageSize = pageSize;
+    m_slotSize = pageSize + 2 * border;
+    if ((PageCountX(0) > 256) or (PageCountY(0) > 256)) {
+        fprintf(stderr, "VirtualTexture: '%s' needs more than 256 x 256 pages; use a larger page size\n", (const char*)m_name);
+        return false;
+    }
+    m_levelCount = 1;
+    while ((m_levelCount < int(header->levelCount)) and ((PageCountX(m_levelCount - 1) > 1) or (PageCountY(m_levelCount - 1) > 1)))
+        ++m_levelCount;
+
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    m_slotsPerRow = std::min(int(ceilf(sqrtf(float(std::max(slotCount, 2))))), int(maxTextureSize) / m_slotSize);
+    if (m_slotsPerRow < 1) {
+        fprintf(stderr, "VirtualTexture: pages of '%s' don't fit in a texture; use a smaller page size\n", (const char*)m_name);
+        Destroy();
+        return false;
+    }
+    int physicalSize = m_slotsPerRow * m_slotSize;
+    m_slots.assign(size_t(m_slotsPerRow) * size_t(m_slotsPerRow), Slot{ invalidPage, 0, false });
+
+    if (not (m_pageTable.Create() and m_physicalPages.Create())) {
+        Destroy();
+        return false;
+    }
+    m_pageTable.HasBuffer() = true;
+    m_physicalPages.HasBuffer() = true;
+    m_physicalPages.Bind();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, physicalSize, physicalSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    m_physicalPages.Release();
+    m_pageTableData.assign(size_t(PageCountX(0)) * size_t(PageCountY(0)) * 4, 0);
+    m_pageTable.Bind();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, PageCountX(0), PageCountY(0), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    m_pageTable.Release();
+
+    // the single page of the coarsest level is the fallback for all texels and always stays resident
+    m_requests.assign(1, PageKey(m_levelCount - 1, 0, 0));
+    if (Update(1) != 1) {
+        fprintf(stderr, "VirtualTexture: couldn't load the coarsest page of '%s'\n", (const char*)m_name);
+        Destroy();
+        return false;
+    }
+    m_slots[m_pageSlots[m_requests.front()]].isPinned = true;
+    m_requests.clear();
+    return true;
+}
+
+
+void VirtualTexture::Destroy(void) {
+    m_pageTable.Destroy();
+    m_physicalPages.Destroy();
+    m_source.reset();
+    m_slots.clear();
+    m_pageSlots.clear();
+    m_requests.clear();
+    m_pageTableData.clear();
+    m_stats = PageStats();
+}
+
+
+void VirtualTexture::ReadFeedback(int width, int height) {
+    m_feedback.resize(size_t(width) * size_t(height) * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, m_feedback.data());
+    ProcessFeedback(m_feedback.data(), width * height);
+}
+
+
+// Requesting a page also requests all coarser pages covering it, so that the page table can fall back to them
+// gradually while finer pages are still streaming in. Coarse pages are requested first.
+void VirtualTexture::ProcessFeedback(const uint8_t* feedback, int pixelCount) {
+    m_requests.clear();
+    uint32_t lastPage = invalidPage;
+    for (int i = 0; i < pixelCount; i++, feedback += 4) {
+        if (feedback[3] == 0) // no geometry using the virtual texture here
+            continue;
+        int level = std::min(int(feedback[2]), m_levelCount - 1);
+        int x = feedback[0], y = feedback[1];
+        if ((x >= PageCountX(level)) or (y >= PageCountY(level)))
+            continue;
+        uint32_t page = PageKey(level, x, y);
+        if (page == lastPage) // neighbouring texels mostly want the same page
+            continue;
+        lastPage = page;
+        for (; level < m_levelCount; level++, x >>= 1, y >>= 1)
+            m_requests.push_back(PageKey(level, x, y));
+    }
+    std::sort(m_requests.begin(), m_requests.end(), [](uint32_t a, uint32_t b) { return a > b; });
+    m_requests.erase(std::unique(m_requests.begin(), m_requests.end()), m_requests.end());
+    m_stats.requestCount = int(m_requests.size());
+}
+
+
+// free slots first, then the least recently used page that hasn't been requested in this update
+int VirtualTexture::AllocateSlot(void) {
+    int lruSlot = -1;
+    for (int i = 0; i < int(m_slots.size()); i++) {
+        Slot& slot = m_slots[i];
+        if (slot.page == invalidPage)
+            return i;
+        if (not slot.isPinned and (slot.lastUsed != m_frame) and ((lruSlot < 0) or (slot.lastUsed < m_slots[lruSlot].lastUsed)))
+            lruSlot = i;
+    }
+    if (lruSlot >= 0)
+        m_pageSlots.erase(m_slots[lruSlot].page);
+    return lruSlot;
+}
+
+
+// copy the page incl. its border from the mapped mip level to dest as RGBA. Pixels outside the level repeat its edge.
+void VirtualTexture::ExtractPage(uint32_t page, uint8_t* dest) {
+    int level = PageLevel(page);
+    int w = LevelWidth(level), h = LevelHeight(level);
+    int componentCount = int(m_source->m_header->componentCount);
+    const uint8_t* levelData = (const uint8_t*)m_source->ImageData(0) + TextureFile::ChainSize(m_width, m_height, componentCount, level);
+    int x0 = PageX(page) * m_pageSize - border;
+    int y0 = PageY(page) * m_pageSize - border;
+    for (int y = 0; y < m_slotSize; y++) {
+        const uint8_t* row = levelData + size_t(std::min(std::max(y0 + y, 0), h - 1)) * size_t(w) * size_t(componentCount);
+        for (int x = 0; x < m_slotSize; x++, dest += 4) {
+            const uint8_t* p = row + std::min(std::max(x0 + x, 0), w - 1) * componentCount;
+            dest[0] = p[0];
+            dest[1] = p[1];
+            dest[2] = p[2];
+            dest[3] = (componentCount == 4) ? p[3] : 255;
+        }
+    }
+}
+
+
+// The page table is filled from the coarsest to the finest resident pages, each covering the level 0 cells below it
+void VirtualTexture::UpdatePageTable(void) {
+    std::vector<int> residentSlots;
+    for (int i = 0; i < int(m_slots.size()); i++)
+        if (m_slots[i].page != invalidPage)
+            residentSlots.push_back(i);
+    std::sort(residentSlots.begin(), residentSlots.end(), [this](int a, int b) { return m_slots[a].page > m_slots[b].page; });
+    int tableWidth = PageCountX(0), tableHeight = PageCountY(0);
+    for (int i : residentSlots) {
+        uint32_t page = m_slots[i].page;
+        int level = PageLevel(page);
+        uint8_t entry[4] = { uint8_t(i % m_slotsPerRow), uint8_t(i / m_slotsPerRow), uint8_t(level), 255 };
+        int xMax = std::min((PageX(page) + 1) << level, tableWidth);
+        int yMax = std::min((PageY(page) + 1) << level, tableHeight);
+        for (int y = PageY(page) << level; y < yMax; y++)
+            for (int x = PageX(page) << level; x < xMax; x++)
+                memcpy(m_pageTableData.data() + 4 * (size_t(y) * tableWidth + x), entry, 4);
+    }
+    m_pageTable.Bind(); // makes the page table's unit active, also if it is enabled there already
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tableWidth, tableHeight, GL_RGBA, GL_UNSIGNED_BYTE, m_pageTableData.data());
+    m_pageTable.Release();
+    m_stats.residentCount = int(residentSlots.size());
+}
+
+
+// Missing pages are extracted from the mapped source by the worker pool and then uploaded to their slots
+int VirtualTexture::Update(int maxUploads) {
+    if (not m_source)
+        return 0;
+    ++m_frame;
+    std::vector<uint32_t> missingPages;
+    for (uint32_t page : m_requests) {
+        auto it = m_pageSlots.find(page);
+        if (it != m_pageSlots.end())
+            m_slots[it->second].lastUsed = m_frame;
+        else if (int(missingPages.size()) < maxUploads)
+            missingPages.push_back(page);
+    }
+    std::vector<int> slots;
+    for (uint32_t page : missingPages) {
+        int slot = AllocateSlot();
+        if (slot < 0) // all slots are needed for the current frame
+            break;
+        m_slots[slot] = { page, m_frame, false };
+        m_pageSlots[page] = slot;
+        slots.push_back(slot);
+    }
+    int uploadCount = int(slots.size());
+    m_stats.uploadCount = uploadCount;
+    if (uploadCount == 0)
+        return 0;
+    size_t pageBytes = size_t(m_slotSize) * size_t(m_slotSize) * 4;
+    std::vector<uint8_t> pageData(pageBytes * size_t(uploadCount));
+    workerPool.ParallelFor(uploadCount, [&](int i) {
+        ExtractPage(m_slots[slots[i]].page, pageData.data() + size_t(i) * pageBytes);
+        });
+    m_physicalPages.Bind(); // see UpdatePageTable()
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int i = 0; i < uploadCount; i++)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slots[i] % m_slotsPerRow) * m_slotSize, (slots[i] / m_slotsPerRow) * m_slotSize, m_slotSize, m_slotSize,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pageData.data() + size_t(i) * pageBytes);
+    m_physicalPages.Release();
+    UpdatePageTable();
+    return uploadCount;
+}
+
+
+Shader* VirtualTexture::SetupShader(int firstTmu, const RGBAColor& color) {
+    Shader* shader = baseShaderHandler.SetupShader("virtualTexture");
+    if (shader) {
+        m_pageTable.Enable(firstTmu);
+        m_physicalPages.Enable(firstTmu + 1);
+        static ShaderLocationTable locations;
+        locations.Start();
+        shader->SetInt("pageTable", locations.Current(), firstTmu);
+        shader->SetInt("physicalPages", locations.Current(), firstTmu + 1);
+        shader->SetVector2f("virtualSize", locations.Current(), float(m_width), float(m_height));
+        shader->SetFloat("pageSize", locations.Current(), float(m_pageSize));
+        shader->SetFloat("slotSize", locations.Current(), float(m_slotSize));
+        shader->SetFloat("border", locations.Current(), float(border));
+        shader->SetVector4f("surfaceColor", locations.Current(), color);
+    }
+    return shader;
+}
+
+
+Shader* VirtualTexture::SetupFeedbackShader(float feedbackScale) {
+    Shader* shader = baseShaderHandler.SetupShader("virtualTextureFeedback");
+    if (shader) {
+        static ShaderLocationTable locations;
+        locations.Start();
+        shader->SetVector2f("virtualSize", locations.Current(), float(m_width), float(m_height));
+        shader->SetFloat("pageSize", locations.Current(), float(m_pageSize));
+        shader->SetFloat("lodBias", locations.Current(), log2f(std::max(feedbackScale, 1.0f)));
+        shader->SetFloat("maxLevel", locations.Current(), float(m_levelCount - 1));
+    }
+    return shader;
+}
+
+// =================================================================================================
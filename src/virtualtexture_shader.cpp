@@ -0,0 +1,81 @@
+
+#include "array.hpp"
+#include "string.hpp"
+#include "base_shadercode.h"
+
+// =================================================================================================
+// Virtual texture shaders; see VirtualTexture
+
+// look up the slot of the finest resident page covering the fragment in the page table and sample the physical
+// page texture there. Coordinates inside the page are clamped to the page's border.
+const ShaderSource& VirtualTextureShader() {
+    static const ShaderSource virtualTextureShader(
+        "virtualTexture",
+        StandardVS(),
+        R"(
+        //#version 140
+        //#extension GL_ARB_explicit_attrib_location : enable
+        #version 330
+        uniform sampler2D pageTable;
+        uniform sampler2D physicalPages;
+        uniform vec2 virtualSize;
+        uniform float pageSize;
+        uniform float slotSize;
+        uniform float border;
+        uniform vec4 surfaceColor;
+        in vec3 fragPos;
+        in vec2 fragTexCoord;
+
+        layout(location = 0) out vec4 fragColor;
+
+        void main() {
+            vec2 uv = clamp(fragTexCoord, 0.0, 1.0);
+            ivec2 cell = min(ivec2(uv * virtualSize / pageSize), textureSize(pageTable, 0) - 1);
+            ivec3 entry = ivec3(texelFetch(pageTable, cell, 0).rgb * 255.0 + 0.5);
+            int level = entry.b;
+            vec2 levelSize = max(floor(virtualSize / exp2(float(level))), vec2(1.0));
+            vec2 offset = clamp(uv * levelSize - vec2(cell >> level) * pageSize, vec2(0.5 - border), vec2(pageSize + border - 0.5));
+            vec2 physicalPos = (vec2(entry.rg) * slotSize + border + offset) / vec2(textureSize(physicalPages, 0));
+            vec4 texColor = texture(physicalPages, physicalPos);
+            fragColor = vec4(texColor.rgb * surfaceColor.rgb, texColor.a * surfaceColor.a);
+            }
+    )"
+    );
+    return virtualTextureShader;
+}
+
+
+// write the page (x, y, level) the fragment needs. The texel footprint is computed from the screen space derivatives;
+// lodBias compensates the reduced resolution of the feedback pass.
+const ShaderSource& VirtualTextureFeedbackShader() {
+    static const ShaderSource virtualTextureFeedbackShader(
+        "virtualTextureFeedback",
+        StandardVS(),
+        R"(
+        //#version 140
+        //#extension GL_ARB_explicit_attrib_location : enable
+        #version 330
+        uniform vec2 virtualSize;
+        uniform float pageSize;
+        uniform float lodBias;
+        uniform float maxLevel;
+        in vec3 fragPos;
+        in vec2 fragTexCoord;
+
+        layout(location = 0) out vec4 fragColor;
+
+        void main() {
+            vec2 texel = fragTexCoord * virtualSize;
+            vec2 dx = dFdx(texel);
+            vec2 dy = dFdy(texel);
+            float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) - lodBias;
+            int level = int(clamp(floor(lod), 0.0, maxLevel));
+            ivec2 cell = min(ivec2(clamp(fragTexCoord, 0.0, 1.0) * virtualSize / pageSize), ivec2(ceil(virtualSize / pageSize)) - 1);
+            fragColor = vec4(vec2(cell >> level), float(level), 255.0) / 255.0;
+            }
+    )"
+    );
+    return virtualTextureFeedbackShader;
+}
+
+// =================================================================================================
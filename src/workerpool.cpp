@@ -0,0 +1,123 @@
+#include <algorithm>
+#include "workerpool.h"
+
+// =================================================================================================
+// Small worker thread pool for CPU side preparation work (image decoding, pixel conversion etc.)
+
+bool WorkerPool::Start(int workerCount) {
+    if (m_isRunning)
+        return true;
+    if (workerCount <= 0)
+        workerCount = int(std::thread::hardware_concurrency()) - 1;
+    if (workerCount <= 0) // single core machine: Submit() will execute tasks immediately
+        return false;
+    m_isRunning = true;
+    for (int i = 0; i < workerCount; i++)
+        m_workers.emplace_back(&WorkerPool::Run, this);
+    return true;
+}
+
+
+void WorkerPool::Stop(void) {
+    if (not m_isRunning)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_isRunning = false;
+    }
+    m_wakeUp.notify_all();
+    for (auto& w : m_workers)
+        w.join();
+    m_workers.clear();
+}
+
+
+void WorkerPool::Submit(Task task) {
+    if (not (m_isRunning or Start())) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_tasks.push_back(std::move(task));
+    }
+    m_wakeUp.notify_one();
+}
+
+
+void WorkerPool::Wait(void) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_idle.wait(lock, [this] { return m_tasks.empty() and (m_busyCount == 0); });
+}
+
+
+void WorkerPool::ParallelFor(int count, std::function<void(int)> task) {
+    struct Work {
+        std::function<void(int)>    task;
+        std::atomic<int>            next{ 0 };
+        int                         count;
+        int                         doneCount{ 0 };
+        std::exception_ptr          error; // first exception thrown by task
+        std::mutex                  lock;
+        std::condition_variable     done;
+    };
+
+    if (count <= 0)
+        return;
+    if (not m_isRunning)
+        Start();
+    // helpers may only get to run after all items have been processed, so they share ownership of the work
+    std::shared_ptr<Work> work = std::make_shared<Work>();
+    work->task = std::move(task);
+    work->count = count;
+    auto process = [](Work& w) {
+        int i;
+        while ((i = w.next.fetch_add(1)) < w.count) {
+            // an item that throws still counts as done, so the caller doesn't wait forever; it rethrows the exception
+            std::exception_ptr error;
+            try {
+                w.task(i);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(w.lock);
+            if (error and not w.error)
+                w.error = error;
+            if (++w.doneCount == w.count)
+                w.done.notify_all();
+        }
+    };
+    int helperCount = std::min(count - 1, WorkerCount());
+    for (int i = 0; i < helperCount; i++)
+        Submit([work, process] { process(*work); });
+    process(*work);
+    std::unique_lock<std::mutex> lock(work->lock);
+    work->done.wait(lock, [&work] { return work->doneCount == work->count; });
+    if (work->error)
+        std::rethrow_exception(work->error);
+}
+
+
+void WorkerPool::Run(void) {
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_wakeUp.wait(lock, [this] { return not (m_isRunning and m_tasks.empty()); });
+            if (m_tasks.empty()) // only happens when the pool is being stopped
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            ++m_busyCount;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            --m_busyCount;
+        }
+        m_idle.notify_all();
+    }
+}
+
+// =================================================================================================